@@ -11,9 +11,40 @@
 #define CRCPP_USE_CPP11
 #include "CRC.h"
 
+#include <pthread.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CRC_FOLDING
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 //Construct the CRC table as a global variable
 static auto crc_table = CRC::CRC_32().MakeTable();
 
+//Tables for processing 16 bytes at a time. slice_tables[0] is the CRC++ table and
+//slice_tables[k][i] is the remainder of byte i followed by k zero bytes.
+struct SliceTables {
+    u32 table[16][256];
+
+    SliceTables(){
+        for (unsigned int i = 0; i < 256; i++)
+            table[0][i] = crc_table[static_cast<unsigned char>(i)];
+
+        for (unsigned int k = 1; k < 16; k++)
+            for (unsigned int i = 0; i < 256; i++)
+                table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+    }
+};
+
+static const SliceTables slice_tables;
+
+//Reads a little endian 32 bit word
+static inline u32 load_u32(const unsigned char* data){
+    return static_cast<u32>(data[0]) | (static_cast<u32>(data[1]) << 8)
+        | (static_cast<u32>(data[2]) << 16) | (static_cast<u32>(data[3]) << 24);
+}
+
 
 u32 crc_init(unsigned char first_byte){
     return CRC::Calculate(&first_byte, 1, crc_table);
@@ -21,4 +52,439 @@ u32 crc_init(unsigned char first_byte){
 
 u32 crc_continue(unsigned char next_byte, u32 old_crc){
     return CRC::Calculate(&next_byte, 1, crc_table, old_crc);
+}
+
+//Slice-by-16 over the reflected CRC_32 table. Works on the raw remainder, without
+//the final XOR.
+static u32 crc_slice16(const unsigned char* data, size_t length, u32 remainder){
+    const auto& t = slice_tables.table;
+
+    while (length >= 16) {
+        u32 word0 = remainder ^ load_u32(data);
+        u32 word1 = load_u32(data + 4);
+        u32 word2 = load_u32(data + 8);
+        u32 word3 = load_u32(data + 12);
+
+        remainder = t[15][word0 & 0xff] ^ t[14][(word0 >> 8) & 0xff] ^ t[13][(word0 >> 16) & 0xff] ^ t[12][word0 >> 24]
+            ^ t[11][word1 & 0xff] ^ t[10][(word1 >> 8) & 0xff] ^ t[9][(word1 >> 16) & 0xff] ^ t[8][word1 >> 24]
+            ^ t[7][word2 & 0xff] ^ t[6][(word2 >> 8) & 0xff] ^ t[5][(word2 >> 16) & 0xff] ^ t[4][word2 >> 24]
+            ^ t[3][word3 & 0xff] ^ t[2][(word3 >> 8) & 0xff] ^ t[1][(word3 >> 16) & 0xff] ^ t[0][word3 >> 24];
+
+        data += 16;
+        length -= 16;
+    }
+
+    while (length > 0) {
+        remainder = (remainder >> 8) ^ t[0][(remainder ^ *data) & 0xff];
+        data++;
+        length--;
+    }
+
+    return remainder;
+}
+
+//A folding kernel takes a length which is a multiple of 16 and at least 64.
+typedef u32 (*crc_kernel_t)(const unsigned char* data, size_t length, u32 remainder);
+
+#ifdef CRC_FOLDING
+
+//Folding constants for the reflected CRC_32 polynomial, following Intel's "Fast CRC
+//Computation for Generic Polynomials Using PCLMULQDQ Instruction". Each pair is
+//x^(d+32) mod P and x^(d-32) mod P, bit-reflected and shifted left by one, for a
+//folding distance of d bits.
+alignas(16) static const uint64_t fold_2048[2] = {0x11542778a, 0x1322d1430};
+alignas(16) static const uint64_t fold_512[2] = {0x154442bd4, 0x1c6e41596};
+alignas(16) static const uint64_t fold_128[2] = {0x1751997d0, 0x0ccaa009e};
+alignas(16) static const uint64_t fold_64[2] = {0x163cd6124, 0x000000000};
+alignas(16) static const uint64_t barrett[2] = {0x1db710641, 0x1f7011641};
+
+//Folds the 128 bits in x forward by the distance of k, then adds in y
+__attribute__((target("pclmul,sse4.1")))
+static inline __m128i fold_128_bits(__m128i x, __m128i k, __m128i y){
+    __m128i low = _mm_clmulepi64_si128(x, k, 0x00);
+    __m128i high = _mm_clmulepi64_si128(x, k, 0x11);
+    return _mm_xor_si128(_mm_xor_si128(low, high), y);
+}
+
+//Folds 16 bytes at a time into x, then reduces x to the 32 bit remainder
+__attribute__((target("pclmul,sse4.1")))
+static u32 crc_fold_finish(__m128i x, const unsigned char* data, size_t length){
+    __m128i k = _mm_load_si128(reinterpret_cast<const __m128i*>(fold_128));
+    __m128i low_mask = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i y;
+
+    while (length >= 16) {
+        x = fold_128_bits(x, k, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)));
+        data += 16;
+        length -= 16;
+    }
+
+    //128 bits to 64 bits
+    y = _mm_clmulepi64_si128(x, k, 0x10);
+    x = _mm_xor_si128(_mm_srli_si128(x, 8), y);
+
+    k = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(fold_64));
+    y = _mm_srli_si128(x, 4);
+    x = _mm_clmulepi64_si128(_mm_and_si128(x, low_mask), k, 0x00);
+    x = _mm_xor_si128(x, y);
+
+    //Barrett reduction to 32 bits
+    k = _mm_load_si128(reinterpret_cast<const __m128i*>(barrett));
+    y = _mm_clmulepi64_si128(_mm_and_si128(x, low_mask), k, 0x10);
+    y = _mm_clmulepi64_si128(_mm_and_si128(y, low_mask), k, 0x00);
+    x = _mm_xor_si128(x, y);
+
+    return static_cast<u32>(_mm_extract_epi32(x, 1));
+}
+
+//Four 128 bit lanes are folded 64 bytes at a time, then combined into one.
+__attribute__((target("pclmul,sse4.1")))
+static u32 crc_pclmul(const unsigned char* data, size_t length, u32 remainder){
+    const __m128i* blocks = reinterpret_cast<const __m128i*>(data);
+    __m128i x0 = _mm_xor_si128(_mm_loadu_si128(blocks), _mm_cvtsi32_si128(static_cast<int>(remainder)));
+    __m128i x1 = _mm_loadu_si128(blocks + 1);
+    __m128i x2 = _mm_loadu_si128(blocks + 2);
+    __m128i x3 = _mm_loadu_si128(blocks + 3);
+    __m128i k = _mm_load_si128(reinterpret_cast<const __m128i*>(fold_512));
+
+    data += 64;
+    length -= 64;
+
+    while (length >= 64) {
+        blocks = reinterpret_cast<const __m128i*>(data);
+        x0 = fold_128_bits(x0, k, _mm_loadu_si128(blocks));
+        x1 = fold_128_bits(x1, k, _mm_loadu_si128(blocks + 1));
+        x2 = fold_128_bits(x2, k, _mm_loadu_si128(blocks + 2));
+        x3 = fold_128_bits(x3, k, _mm_loadu_si128(blocks + 3));
+        data += 64;
+        length -= 64;
+    }
+
+    k = _mm_load_si128(reinterpret_cast<const __m128i*>(fold_128));
+    x0 = fold_128_bits(x0, k, x1);
+    x0 = fold_128_bits(x0, k, x2);
+    x0 = fold_128_bits(x0, k, x3);
+
+    return crc_fold_finish(x0, data, length);
+}
+
+//Folds 512 bit registers, each holding four 128 bit lanes
+__attribute__((target("avx512f,vpclmulqdq")))
+static inline __m512i fold_512_bits(__m512i x, __m512i k, __m512i y){
+    __m512i low = _mm512_clmulepi64_epi128(x, k, 0x00);
+    __m512i high = _mm512_clmulepi64_epi128(x, k, 0x11);
+    return _mm512_ternarylogic_epi64(low, high, y, 0x96);
+}
+
+//Four 512 bit registers are folded 256 bytes at a time, then combined into a single
+//128 bit lane for crc_fold_finish. Falls back to crc_pclmul for short buffers.
+__attribute__((target("avx512f,vpclmulqdq,pclmul,sse4.1")))
+static u32 crc_vpclmul(const unsigned char* data, size_t length, u32 remainder){
+    if (length < 256)
+        return crc_pclmul(data, length, remainder);
+
+    __m512i x0 = _mm512_xor_si512(_mm512_loadu_si512(data), _mm512_set_epi64(0, 0, 0, 0, 0, 0, 0, remainder));
+    __m512i x1 = _mm512_loadu_si512(data + 64);
+    __m512i x2 = _mm512_loadu_si512(data + 128);
+    __m512i x3 = _mm512_loadu_si512(data + 192);
+    __m512i k = _mm512_set_epi64(fold_2048[1], fold_2048[0], fold_2048[1], fold_2048[0],
+        fold_2048[1], fold_2048[0], fold_2048[1], fold_2048[0]);
+
+    data += 256;
+    length -= 256;
+
+    while (length >= 256) {
+        x0 = fold_512_bits(x0, k, _mm512_loadu_si512(data));
+        x1 = fold_512_bits(x1, k, _mm512_loadu_si512(data + 64));
+        x2 = fold_512_bits(x2, k, _mm512_loadu_si512(data + 128));
+        x3 = fold_512_bits(x3, k, _mm512_loadu_si512(data + 192));
+        data += 256;
+        length -= 256;
+    }
+
+    k = _mm512_set_epi64(fold_512[1], fold_512[0], fold_512[1], fold_512[0],
+        fold_512[1], fold_512[0], fold_512[1], fold_512[0]);
+    x0 = fold_512_bits(x0, k, x1);
+    x0 = fold_512_bits(x0, k, x2);
+    x0 = fold_512_bits(x0, k, x3);
+
+    while (length >= 64) {
+        x0 = fold_512_bits(x0, k, _mm512_loadu_si512(data));
+        data += 64;
+        length -= 64;
+    }
+
+    alignas(64) __m128i lanes[4];
+    _mm512_store_si512(lanes, x0);
+
+    __m128i k128 = _mm_load_si128(reinterpret_cast<const __m128i*>(fold_128));
+    __m128i x = fold_128_bits(lanes[0], k128, lanes[1]);
+    x = fold_128_bits(x, k128, lanes[2]);
+    x = fold_128_bits(x, k128, lanes[3]);
+
+    return crc_fold_finish(x, data, length);
+}
+
+//Checks a kernel against CRC::Calculate over a range of lengths and alignments
+static bool kernel_matches(crc_kernel_t kernel){
+    unsigned char data[1024 + 16];
+    u32 state = 1;
+
+    for (unsigned int i = 0; i < sizeof(data); i++) {
+        state = state * 1103515245 + 12345;
+        data[i] = static_cast<unsigned char>(state >> 16);
+    }
+
+    for (size_t offset = 0; offset < 16; offset += 5) {
+        for (size_t length = 64; length <= 1024; length += 16 * 7) {
+            u32 expected = CRC::Calculate(data + offset, length, crc_table, static_cast<u32>(offset));
+            u32 remainder = static_cast<u32>(offset) ^ CRC::CRC_32().finalXOR;
+
+            if ((kernel(data + offset, length, remainder) ^ CRC::CRC_32().finalXOR) != expected)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+//Finds which folding kernels the CPU and OS support
+static void find_kernels(bool* has_pclmul, bool* has_vpclmul){
+    unsigned int eax, ebx, ecx, edx;
+
+    *has_pclmul = false;
+    *has_vpclmul = false;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return;
+
+    *has_pclmul = (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+    bool has_osxsave = ecx & bit_OSXSAVE;
+
+    if (*has_pclmul && has_osxsave && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        unsigned int xcr0_low, xcr0_high;
+        __asm__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+
+        //The OS must save the SSE, AVX and AVX-512 register state
+        *has_vpclmul = (ebx & bit_AVX512F) && (ecx & bit_VPCLMULQDQ) && (xcr0_low & 0xe6) == 0xe6;
+    }
+}
+
+//Picks the widest folding kernel supported by the CPU and OS which passes kernel_matches
+static crc_kernel_t select_kernel(){
+    bool has_pclmul, has_vpclmul;
+    find_kernels(&has_pclmul, &has_vpclmul);
+
+    if (has_vpclmul && kernel_matches(crc_vpclmul))
+        return crc_vpclmul;
+
+    if (has_pclmul && kernel_matches(crc_pclmul))
+        return crc_pclmul;
+
+    return nullptr;
+}
+
+//Every kernel this CPU can run, ending with nullptr for slice-by-16 alone
+static unsigned int supported_kernels(crc_kernel_t* kernels){
+    bool has_pclmul, has_vpclmul;
+    unsigned int count = 0;
+    find_kernels(&has_pclmul, &has_vpclmul);
+
+    if (has_vpclmul)
+        kernels[count++] = crc_vpclmul;
+
+    if (has_pclmul)
+        kernels[count++] = crc_pclmul;
+
+    kernels[count++] = nullptr;
+    return count;
+}
+
+#else
+
+static crc_kernel_t select_kernel(){
+    return nullptr;
+}
+
+static unsigned int supported_kernels(crc_kernel_t* kernels){
+    kernels[0] = nullptr;
+    return 1;
+}
+
+#endif
+
+static const crc_kernel_t crc_kernel = select_kernel();
+
+
+//Uses the folding kernel (if not nullptr) when the buffer is long enough, and
+//slice-by-16 for the rest. Like CRC::Calculate, the final XOR is undone before
+//continuing from old_crc and applied again at the end.
+static u32 crc_buffer_with(crc_kernel_t kernel, const unsigned char* data, size_t length, u32 old_crc){
+    u32 remainder = old_crc ^ CRC::CRC_32().finalXOR;
+
+    if (kernel != nullptr && length >= 64) {
+        size_t folded = length & ~static_cast<size_t>(15);
+        remainder = kernel(data, folded, remainder);
+        data += folded;
+        length -= folded;
+    }
+
+    remainder = crc_slice16(data, length, remainder);
+
+    return remainder ^ CRC::CRC_32().finalXOR;
+}
+
+u32 crc_buffer(const unsigned char* data, size_t length, u32 old_crc){
+    return crc_buffer_with(crc_kernel, data, length, old_crc);
+}
+
+//Longest buffer and furthest alignment covered by crc_self_test
+#define SELF_TEST_LENGTH 4096
+#define SELF_TEST_ALIGNMENT 64
+
+int crc_self_test(unsigned int seed, unsigned int lengths_per_alignment){
+    static unsigned char data[SELF_TEST_ALIGNMENT + SELF_TEST_LENGTH];
+    crc_kernel_t kernels[3];
+    unsigned int num_kernels = supported_kernels(kernels);
+    u32 state = seed;
+    int failures = 0;
+
+    for (unsigned int i = 0; i < sizeof(data); i++) {
+        state = state * 1103515245 + 12345;
+        data[i] = static_cast<unsigned char>(state >> 16);
+    }
+
+    for (size_t offset = 0; offset < SELF_TEST_ALIGNMENT; offset++) {
+        for (unsigned int i = 0; i < lengths_per_alignment; i++) {
+            //Every length up to 256 in turn, where the tails are, then random ones up to SELF_TEST_LENGTH
+            state = state * 1103515245 + 12345;
+            size_t length = (i <= 256) ? i : (state >> 8) % (SELF_TEST_LENGTH + 1);
+            u32 old_crc = (i % 2 == 0) ? 0 : state;
+            u32 expected = CRC::Calculate(data + offset, length, crc_table, old_crc);
+
+            for (unsigned int k = 0; k < num_kernels; k++) {
+                if (crc_buffer_with(kernels[k], data + offset, length, old_crc) != expected)
+                    failures++;
+            }
+        }
+    }
+
+    return failures;
+}
+
+//Polynomial arithmetic modulo the CRC_32 polynomial in the reflected domain, where
+//bit 31 holds the coefficient of x^0. Follows crc32_combine from zlib.
+static u32 reflect_polynomial(){
+    u32 polynomial = CRC::CRC_32().polynomial, reflected = 0;
+
+    for (unsigned int i = 0; i < 32; i++)
+        reflected |= ((polynomial >> i) & 1) << (31 - i);
+
+    return reflected;
+}
+
+static const u32 reflected_polynomial = reflect_polynomial();
+
+//Returns a * b mod P
+static u32 multiply_mod(u32 a, u32 b){
+    u32 m = static_cast<u32>(1) << 31;
+    u32 product = 0;
+
+    while (m != 0 && (a & ((m << 1) - 1)) != 0) {
+        if (a & m)
+            product ^= b;
+
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ reflected_polynomial : b >> 1;
+    }
+
+    return product;
+}
+
+//x^(2^k) mod P for k = 0..63
+struct PowerTable {
+    u32 table[64];
+
+    PowerTable(){
+        u32 p = static_cast<u32>(1) << 30;
+
+        for (unsigned int k = 0; k < 64; k++) {
+            table[k] = p;
+            p = multiply_mod(p, p);
+        }
+    }
+};
+
+static const PowerTable power_table;
+
+u32 crc_combine(u32 crc_a, u32 crc_b, uint64_t length_b){
+    //x^(8 * length_b) mod P, built from the powers x^(2^k) with k >= 3. The top bits of length_b need k up to 66, 
+    //past the table, but x^(2^32) = x mod P, so the powers repeat every 32 squarings and k can wrap at 64
+    u32 shift = static_cast<u32>(1) << 31;
+
+    for (unsigned int k = 3; length_b != 0; k++, length_b >>= 1) {
+        if (length_b & 1)
+            shift = multiply_mod(power_table.table[k % 64], shift);
+    }
+
+    return multiply_mod(shift, crc_a) ^ crc_b;
+}
+
+//Smallest chunk worth handing to a separate thread
+#define MIN_PARALLEL_CHUNK (1 << 18)
+#define MAX_CRC_THREADS 64
+
+struct CrcTask {
+    const unsigned char* data;
+    size_t length;
+    u32 crc;
+};
+
+static void* crc_task(void* arg){
+    CrcTask* task = static_cast<CrcTask*>(arg);
+    task->crc = crc_buffer(task->data, task->length, task->crc);
+    return nullptr;
+}
+
+u32 crc_buffer_parallel(const unsigned char* data, size_t length, u32 old_crc, unsigned int num_threads){
+    if (num_threads > MAX_CRC_THREADS)
+        num_threads = MAX_CRC_THREADS;
+
+    if (num_threads > length / MIN_PARALLEL_CHUNK)
+        num_threads = static_cast<unsigned int>(length / MIN_PARALLEL_CHUNK);
+
+    if (num_threads <= 1)
+        return crc_buffer(data, length, old_crc);
+
+    CrcTask tasks[MAX_CRC_THREADS];
+    pthread_t threads[MAX_CRC_THREADS];
+    bool started[MAX_CRC_THREADS];
+    size_t chunk = length / num_threads;
+
+    for (unsigned int i = 0; i < num_threads; i++) {
+        tasks[i].data = data + i * chunk;
+        tasks[i].length = (i == num_threads - 1) ? length - i * chunk : chunk;
+        tasks[i].crc = 0;
+    }
+
+    tasks[0].crc = old_crc;
+
+    //The first chunk is done on the calling thread. If a thread cannot be started, its chunk is too.
+    for (unsigned int i = 1; i < num_threads; i++)
+        started[i] = pthread_create(&threads[i], nullptr, crc_task, &tasks[i]) == 0;
+
+    crc_task(&tasks[0]);
+    u32 crc = tasks[0].crc;
+
+    for (unsigned int i = 1; i < num_threads; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], nullptr);
+        } else {
+            crc_task(&tasks[i]);
+        }
+
+        crc = crc_combine(crc, tasks[i].crc, tasks[i].length);
+    }
+
+    return crc;
 }
\ No newline at end of file
@@ -11,9 +11,12 @@
 
 #ifdef __cplusplus
 #include <cstdint>
+#include <cstddef>
 #define C_FUNCTION_DECLARATION extern "C"
 using u32 = std::uint32_t;
 #else
+#include "stdint.h"
+#include "stddef.h"
 #define C_FUNCTION_DECLARATION
 typedef uint32_t u32;
 #endif 
@@ -22,6 +25,21 @@ typedef uint32_t u32;
 C_FUNCTION_DECLARATION u32 crc_init(unsigned char first_byte);
 C_FUNCTION_DECLARATION u32 crc_continue(unsigned char next_byte, u32 old_crc);
 
+/* Continues old_crc over length bytes of data. An old_crc of 0 starts a new CRC. */
+C_FUNCTION_DECLARATION u32 crc_buffer(const unsigned char* data, size_t length, u32 old_crc);
+
+/* Returns the CRC of A followed by B, given crc_a, the CRC of A, and crc_b and length_b, the CRC and length of B. */
+C_FUNCTION_DECLARATION u32 crc_combine(u32 crc_a, u32 crc_b, uint64_t length_b);
+
+/* Checks crc_buffer with every CRC kernel the CPU supports against CRC::Calculate, at every alignment from 0 to 63 and
+   for lengths_per_alignment lengths at each: every length up to 256, then random lengths up to 4096, drawn from seed. 
+   Returns the number of mismatches. */
+C_FUNCTION_DECLARATION int crc_self_test(unsigned int seed, unsigned int lengths_per_alignment);
+
+/* Same as crc_buffer, but splits data into num_threads chunks which are checksummed on separate threads and then 
+   combined. Short buffers are checksummed on the calling thread. */
+C_FUNCTION_DECLARATION u32 crc_buffer_parallel(const unsigned char* data, size_t length, u32 old_crc, unsigned int num_threads);
+
 
 
 #endif
\ No newline at end of file
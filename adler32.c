@@ -0,0 +1,65 @@
+/* adler32.c
+
+   Definitions of the functions declared in adler32.h
+
+   Zoe Johnston - 2023/06/25
+*/ 
+
+#include "stdio.h"
+#include "stdint.h"
+#include "adler32.h"
+
+#define ADLER_MOD 65521
+
+// The most bytes that can be summed before the second sum could overflow 32 bits
+#define ADLER_NMAX 5552
+
+/* Return the Adler-32 checksum of the len bytes at data appended to data whose checksum was old_adler. The modulo is 
+   only taken once every ADLER_NMAX bytes. */
+uint32_t adler32(const uint8_t* data, size_t len, uint32_t old_adler) {
+    uint32_t a = old_adler & 0xFFFF, b = old_adler >> 16;
+    size_t chunk;
+
+    while (len > 0) {
+        chunk = (len < ADLER_NMAX) ? len : ADLER_NMAX;
+        len -= chunk;
+
+        while (chunk >= 4) {
+            a += data[0];
+            b += a;
+            a += data[1];
+            b += a;
+            a += data[2];
+            b += a;
+            a += data[3];
+            b += a;
+            data += 4;
+            chunk -= 4;
+        }
+
+        while (chunk > 0) {
+            a += *data++;
+            b += a;
+            chunk--;
+        }
+
+        a %= ADLER_MOD;
+        b %= ADLER_MOD;
+    }
+
+    return (b << 16) | a;
+}
+
+/* Return the Adler-32 checksum of A followed by B, given adler_a, the checksum of A, and adler_b and len_b, the 
+   checksum and length of B. Every byte of B adds the first sum of A to the second sum once more, and the initial 1 of 
+   B's first sum must not be counted twice. */
+uint32_t adler32_combine(uint32_t adler_a, uint32_t adler_b, uint64_t len_b) {
+    uint32_t rem = (uint32_t) (len_b % ADLER_MOD);
+    uint32_t a = adler_a & 0xFFFF, b = adler_a >> 16;
+    uint64_t sum_a, sum_b;
+
+    sum_a = (uint64_t) a + (adler_b & 0xFFFF) + ADLER_MOD - 1;
+    sum_b = (uint64_t) rem * a + b + (adler_b >> 16) + ADLER_MOD - rem;
+
+    return (uint32_t) ((sum_b % ADLER_MOD) << 16 | (sum_a % ADLER_MOD));
+}
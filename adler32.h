@@ -0,0 +1,24 @@
+/* adler32.h
+
+   The Adler-32 checksum used by the zlib format (RFC 1950).
+
+   Zoe Johnston - 2023/06/25
+*/ 
+
+#ifndef ADLER32_H
+#define ADLER32_H
+
+#include "stdio.h"
+#include "stdint.h"
+
+/* The Adler-32 checksum of no data. */
+#define ADLER32_INIT 1
+
+/* Return the Adler-32 checksum of the len bytes at data appended to data whose checksum was old_adler. */
+uint32_t adler32(const uint8_t* data, size_t len, uint32_t old_adler);
+
+/* Return the Adler-32 checksum of A followed by B, given adler_a, the checksum of A, and adler_b and len_b, the 
+   checksum and length of B. */
+uint32_t adler32_combine(uint32_t adler_a, uint32_t adler_b, uint64_t len_b);
+
+#endif
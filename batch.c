@@ -0,0 +1,592 @@
+/* batch.c
+
+   Definitions of the functions declared in batch.h
+
+   Each worker thread has a deque of chunks to compress. It takes the newest chunk from its
+   own deque and, once that is empty, steals the oldest chunk from another worker's. With no
+   chunk to compress, it takes the next file and reads it into chunks from a pool of two
+   per thread, pushing each onto its own deque and writing them out in order as soon as
+   they are compressed, as parallel.c does for a single input. Memory therefore stays
+   bounded by the pool however large the files are. A file no larger than a chunk is
+   compressed straight into its output. While a worker waits for a chunk of its file, it
+   compresses queued chunks itself, and a worker with nothing to do sleeps until the pool
+   changes. Every worker keeps its own window and output buffers for all of its work.
+
+   Zoe Johnston - 2023/06/25
+*/
+
+// For lstat
+#define _POSIX_C_SOURCE 200809L
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "assert.h"
+#include "stdint.h"
+#include "string.h"
+#include "errno.h"
+#include "stdatomic.h"
+#include "pthread.h"
+#include "dirent.h"
+#include "fcntl.h"
+#include "unistd.h"
+#include "sys/stat.h"
+#include "output_stream.h"
+#include "lzss.h"
+#include "deflate.h"
+#include "parallel.h"
+#include "CRC_for_C.h"
+#include "adler32.h"
+#include "batch.h"
+
+#define CHUNKS_PER_THREAD 2
+#define MAX_PATH 4096
+
+/* A chunk of a file. contents holds history_size characters of history followed by the size characters of the chunk,
+ * and last is set for the final chunk of the file. Once done is set, output holds the output_size characters it 
+ * compressed to and check its checksum.
+ */
+typedef struct {
+    uint8_t* contents;
+    uint32_t history_size, size;
+    int last;
+    uint8_t* output;
+    size_t output_size;
+    uint32_t check;
+    atomic_int done;
+} chunk_t;
+
+/* The chunks from top up to bottom, which the owner pushes and pops at the bottom and other workers steal from the
+ * top.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    chunk_t** tasks;
+    uint32_t top, bottom, capacity;
+} deque_t;
+
+struct pool;
+
+/* A thread of the pool, with its own deque of chunks and the window and streams it reuses for all of its work: stream
+ * collects the output of a chunk in memory and output writes the file the worker is reading.
+ */
+typedef struct {
+    struct pool* pool;
+    unsigned int index;
+    deque_t deque;
+    window_t* window;
+    bitstream_t stream, output;
+} worker_t;
+
+/* Files are taken in the order of list from next_file, and pending counts those not yet finished, so the workers can
+ * stop once it reaches 0. The num_free chunks no file is using are at free. changes is advanced whenever a chunk is
+ * queued, compressed or freed or a file is finished, which is everything a worker may wait for. All fields after 
+ * lock are protected by it.
+ */
+typedef struct pool {
+    batch_options_t* options;
+    file_list_t* list;
+    worker_t* workers;
+    unsigned int num_workers;
+    chunk_t* chunks;
+    unsigned int num_chunks;
+    atomic_uint next_file, pending, failures;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    chunk_t** free;
+    unsigned int num_free;
+    uint64_t changes;
+} pool_t;
+
+/* Returns the suffix of the files written for format. */
+static const char* suffix(int format) {
+    return (format == FORMAT_GZIP) ? ".gz" : (format == FORMAT_ZLIB) ? ".zz" : ".deflate";
+}
+
+/* Appends a copy of path to list. */
+static void file_list_append(file_list_t* list, const char* path) {
+    if (list->num_paths == list->capacity) {
+        list->capacity = (list->capacity == 0) ? 64 : list->capacity * 2;
+        list->paths = realloc(list->paths, list->capacity * sizeof(char*));
+        assert(list->paths != NULL);
+    }
+
+    list->paths[list->num_paths] = malloc(strlen(path) + 1);
+    assert(list->paths[list->num_paths] != NULL);
+    strcpy(list->paths[list->num_paths++], path);
+}
+
+/* Adds path to list. If it is a directory, the files in it are added when recursive is set and it is skipped with a
+ * warning otherwise. Symbolic links are skipped with a warning, as gzip does, so that -r cannot loop. Returns 0, or 1 
+ * if path could not be added. */
+int file_list_add(file_list_t* list, const char* path, int recursive) {
+    struct stat info;
+    struct dirent* entry;
+    DIR* dir;
+    char child[MAX_PATH];
+    int result = 0;
+
+    if (lstat(path, &info) != 0) {
+        perror(path);
+        return 1;
+    }
+
+    if (S_ISLNK(info.st_mode)) {
+        fprintf(stderr, "gzoe: %s is a symbolic link -- ignored\n", path);
+        return 0;
+    }
+
+    if (S_ISREG(info.st_mode)) {
+        file_list_append(list, path);
+        return 0;
+    }
+
+    if (!S_ISDIR(info.st_mode) || !recursive) {
+        fprintf(stderr, "gzoe: %s is not a regular file -- ignored\n", path);
+        return 0;
+    }
+
+    if ((dir = opendir(path)) == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        result |= file_list_add(list, child, recursive);
+    }
+
+    closedir(dir);
+    return result;
+}
+
+/* Adds every line of manifest to list as a path. Returns 0, or 1 if any path could not be added. */
+int file_list_read(file_list_t* list, FILE* manifest, int recursive) {
+    char line[MAX_PATH];
+    size_t length;
+    int result = 0;
+
+    while (fgets(line, sizeof(line), manifest) != NULL) {
+        length = strcspn(line, "\r\n");
+        line[length] = '\0';
+
+        if (length > 0)
+            result |= file_list_add(list, line, recursive);
+    }
+
+    return result;
+}
+
+/* Returns how often the pool has changed, for pool_wait. */
+static uint64_t pool_changes(pool_t* pool) {
+    uint64_t changes;
+
+    pthread_mutex_lock(&pool->lock);
+    changes = pool->changes;
+    pthread_mutex_unlock(&pool->lock);
+    return changes;
+}
+
+/* Blocks until the pool has changed since pool_changes returned changes. */
+static void pool_wait(pool_t* pool, uint64_t changes) {
+    pthread_mutex_lock(&pool->lock);
+
+    while (pool->changes == changes)
+        pthread_cond_wait(&pool->changed, &pool->lock);
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Wakes every worker waiting for the pool to change. */
+static void pool_notify(pool_t* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->changes++;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Takes a free chunk from the pool. Returns NULL if every chunk is in use. */
+static chunk_t* take_chunk(pool_t* pool) {
+    chunk_t* chunk = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (pool->num_free > 0)
+        chunk = pool->free[--pool->num_free];
+
+    pthread_mutex_unlock(&pool->lock);
+    return chunk;
+}
+
+/* Returns a chunk to the pool. */
+static void release_chunk(pool_t* pool, chunk_t* chunk) {
+    pthread_mutex_lock(&pool->lock);
+    pool->free[pool->num_free++] = chunk;
+    pool->changes++;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Pushes chunk onto the bottom of deque. */
+static void deque_push(deque_t* deque, chunk_t* chunk) {
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->bottom == deque->capacity && deque->top > 0) {
+        memmove(deque->tasks, deque->tasks + deque->top, (deque->bottom - deque->top) * sizeof(chunk_t*));
+        deque->bottom -= deque->top;
+        deque->top = 0;
+    } else if (deque->bottom == deque->capacity) {
+        deque->capacity = (deque->capacity == 0) ? 64 : deque->capacity * 2;
+        deque->tasks = realloc(deque->tasks, deque->capacity * sizeof(chunk_t*));
+        assert(deque->tasks != NULL);
+    }
+
+    deque->tasks[deque->bottom++] = chunk;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+/* Takes the newest chunk (if from_bottom is set) or the oldest chunk of deque into chunk. Returns 0 if it is empty.
+ */
+static int deque_take(deque_t* deque, chunk_t** chunk, int from_bottom) {
+    int found;
+
+    pthread_mutex_lock(&deque->lock);
+    found = deque->top < deque->bottom;
+
+    if (found && from_bottom)
+        *chunk = deque->tasks[--deque->bottom];
+    else if (found)
+        *chunk = deque->tasks[deque->top++];
+
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+/* Reads up to size characters of input into buffer, stopping short only at the end of the file. Returns the number
+ * read, or -1 if the file cannot be read.
+ */
+static int64_t read_input(int input, uint8_t* buffer, uint32_t size) {
+    uint32_t total = 0;
+    ssize_t result;
+
+    while (total < size) {
+        result = read(input, buffer + total, size - total);
+
+        if (result < 0 && errno == EINTR)
+            continue;
+
+        if (result < 0)
+            return -1;
+
+        if (result == 0)
+            break;
+
+        total += (uint32_t) result;
+    }
+
+    return total;
+}
+
+/* Reads the next chunk of input into chunk, after up to 32K of history: the end of the previous chunk of the file, or
+ * the dictionary if there is none. Returns 0, or 1 if the input cannot be read, in which case the chunk is left empty
+ * and last.
+ */
+static int read_chunk(pool_t* pool, chunk_t* chunk, const chunk_t* previous, int input) {
+    const uint8_t* history = pool->options->dictionary;
+    uint32_t history_size = pool->options->dictionary_size;
+    int64_t size;
+
+    if (previous != NULL) {
+        history = previous->contents;
+        history_size = previous->history_size + previous->size;
+    }
+
+    if (history_size > PAST_SIZE) {
+        history += history_size - PAST_SIZE;
+        history_size = PAST_SIZE;
+    }
+
+    if (history_size > 0)
+        memcpy(chunk->contents, history, history_size);
+
+    size = read_input(input, chunk->contents + history_size, pool->options->chunk_size);
+    chunk->history_size = history_size;
+    chunk->size = (size > 0) ? (uint32_t) size : 0;
+    chunk->last = size < pool->options->chunk_size;
+    atomic_store(&chunk->done, 0);
+    return size < 0;
+}
+
+/* Returns the checksum of size characters of data which the trailer of format needs. */
+static uint32_t checksum(int format, const uint8_t* data, uint64_t size) {
+    return (format == FORMAT_ZLIB) ? adler32(data, size, ADLER32_INIT) : crc_buffer(data, size, 0);
+}
+
+/* Opens the output at path and pushes its header into the worker's output stream. Returns the output, or NULL if it
+ * cannot be created or already exists.
+ */
+static FILE* start_output(worker_t* worker, const char* path) {
+    batch_options_t* options = worker->pool->options;
+    FILE* output;
+
+    // Created exclusively, as gzip does without -f
+    if ((output = fopen(path, "wbx")) == NULL && errno == EEXIST) {
+        fprintf(stderr, "gzoe: %s already exists -- not overwritten\n", path);
+        return NULL;
+    } else if (output == NULL) {
+        perror(path);
+        return NULL;
+    }
+
+    bitstream_init(&worker->output, output);
+    push_header(&worker->output, options->format, options->level, options->dictionary_size, options->dictionary_id);
+    return output;
+}
+
+/* Pushes the trailer for size characters of input with checksum check and closes the output at path. Returns 0, or 1 
+ * if the output could not be written.
+ */
+static int finish_output(worker_t* worker, const char* path, FILE* output, uint32_t check, uint64_t size) {
+    int failed;
+
+    push_trailer(&worker->output, worker->pool->options->format, check, check, (uint32_t) size);
+    bitstream_finalize(&worker->output);
+    failed = ferror(output);
+
+    if (fclose(output) != 0 || failed) {
+        perror(path);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Compresses a chunk into memory and computes its checksum. */
+static void run_chunk(worker_t* worker, chunk_t* chunk) {
+    batch_options_t* options = worker->pool->options;
+    uint8_t* data = chunk->contents + chunk->history_size;
+
+    bitstream_init_memory(&worker->stream);
+    deflate_chunk(&worker->stream, worker->window, options->level, chunk->contents, chunk->history_size, data,
+        chunk->size, chunk->last);
+    bitstream_finalize(&worker->stream);
+
+    chunk->output = worker->stream.memory;
+    chunk->output_size = worker->stream.memory_size;
+    chunk->check = checksum(options->format, data, chunk->size);
+    atomic_store(&chunk->done, 1);
+    pool_notify(worker->pool);
+}
+
+/* Compresses a chunk from the worker's own deque or, if that is empty, stolen from another's. Returns 0 if no chunk
+ * was queued.
+ */
+static int run_task(worker_t* worker) {
+    pool_t* pool = worker->pool;
+    chunk_t* chunk;
+    int found = deque_take(&worker->deque, &chunk, 1);
+
+    for (unsigned int i = 1; !found && i < pool->num_workers; i++)
+        found = deque_take(&pool->workers[(worker->index + i) % pool->num_workers].deque, &chunk, 0);
+
+    if (found)
+        run_chunk(worker, chunk);
+
+    return found;
+}
+
+/* Compresses the file at path to a file of the same name with the suffix of the format. Its chunks are read into free
+ * chunks of the pool and pushed onto the worker's deque, and written out in order as soon as they are compressed. A 
+ * file that fits in its first chunk is compressed straight into the output instead. Returns 0, or 1 if the file could
+ * not be compressed, in which case no output is left behind.
+ */
+static int run_file(worker_t* worker, const char* path) {
+    pool_t* pool = worker->pool;
+    batch_options_t* options = pool->options;
+    const char* ending = suffix(options->format);
+    size_t length = strlen(path);
+    char output_path[MAX_PATH];
+    chunk_t** ring;
+    chunk_t* chunk;
+    uint64_t next_read = 0, next_written = 0, size = 0, changes;
+    uint32_t check = (options->format == FORMAT_ZLIB) ? ADLER32_INIT : 0;
+    int input, reading = 1, failed = 0;
+    FILE* output;
+
+    if (length >= strlen(ending) && strcmp(path + length - strlen(ending), ending) == 0) {
+        fprintf(stderr, "gzoe: %s already has %s suffix -- unchanged\n", path, ending);
+        return 0;
+    }
+
+    if ((input = open(path, O_RDONLY)) < 0) {
+        perror(path);
+        return 1;
+    }
+
+    snprintf(output_path, sizeof(output_path), "%s%s", path, ending);
+
+    if ((output = start_output(worker, output_path)) == NULL) {
+        close(input);
+        return 1;
+    }
+
+    // Chunk n of the file is at ring[n % num_chunks] from when it is read until it is written
+    ring = calloc(pool->num_chunks, sizeof(chunk_t*));
+    assert(ring != NULL);
+
+    while (reading || next_written < next_read) {
+        changes = pool_changes(pool);
+        chunk = ring[next_written % pool->num_chunks];
+
+        // The newest chunk is kept until the next one has been read, as it holds that chunk's history
+        if (next_written < next_read && atomic_load(&chunk->done) && (!reading || next_written + 1 < next_read)) {
+            bitstream_push_bytes(&worker->output, chunk->output, chunk->output_size);
+            free(chunk->output);
+            check = (options->format == FORMAT_ZLIB) ? adler32_combine(check, chunk->check, chunk->size)
+                : crc_combine(check, chunk->check, chunk->size);
+            release_chunk(pool, chunk);
+            next_written++;
+        } else if (reading && (chunk = take_chunk(pool)) != NULL) {
+            if (read_chunk(pool, chunk, (next_read > 0) ? ring[(next_read - 1) % pool->num_chunks] : NULL, input)) {
+                perror(path);
+                failed = 1;
+            }
+
+            size += chunk->size;
+            reading = !chunk->last;
+
+            if (next_read == 0 && chunk->last) {
+                deflate_chunk(&worker->output, worker->window, options->level, chunk->contents, chunk->history_size,
+                    chunk->contents + chunk->history_size, chunk->size, 1);
+                check = checksum(options->format, chunk->contents + chunk->history_size, chunk->size);
+                release_chunk(pool, chunk);
+                next_written++;
+            } else {
+                ring[next_read % pool->num_chunks] = chunk;
+                deque_push(&worker->deque, chunk);
+                pool_notify(pool);
+            }
+
+            next_read++;
+        } else if (!run_task(worker)) {
+            pool_wait(pool, changes);
+        }
+    }
+
+    free(ring);
+    close(input);
+
+    if (finish_output(worker, output_path, output, check, size) || failed) {
+        remove(output_path);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Compresses queued chunks, or else the next file, until every file is finished, sleeping whenever there is nothing
+ * to do until the pool changes.
+ */
+static void* worker_main(void* arg) {
+    worker_t* worker = arg;
+    pool_t* pool = worker->pool;
+    uint64_t changes;
+    unsigned int file;
+
+    while (1) {
+        changes = pool_changes(pool);
+
+        if (run_task(worker))
+            continue;
+
+        if (atomic_load(&pool->next_file) < pool->list->num_paths
+            && (file = atomic_fetch_add(&pool->next_file, 1)) < pool->list->num_paths) {
+            if (run_file(worker, pool->list->paths[file]))
+                atomic_fetch_add(&pool->failures, 1);
+
+            atomic_fetch_sub(&pool->pending, 1);
+            pool_notify(pool);
+        } else if (atomic_load(&pool->pending) == 0) {
+            break;
+        } else {
+            pool_wait(pool, changes);
+        }
+    }
+
+    return NULL;
+}
+
+/* Compresses every file in list, leaving the originals in place. Returns 0 if every file was compressed and 1
+ * otherwise. */
+int compress_batch(file_list_t* list, batch_options_t* options) {
+    pool_t pool;
+    pthread_t threads[MAX_THREADS];
+    unsigned int num_started = 0;
+
+    assert(options->threads >= 1 && options->threads <= MAX_THREADS);
+
+    pool.options = options;
+    pool.list = list;
+    pool.num_workers = options->threads;
+    pool.workers = calloc(pool.num_workers, sizeof(worker_t));
+    pool.num_chunks = CHUNKS_PER_THREAD * pool.num_workers;
+    pool.chunks = calloc(pool.num_chunks, sizeof(chunk_t));
+    pool.free = malloc(pool.num_chunks * sizeof(chunk_t*));
+    pool.num_free = pool.num_chunks;
+    pool.changes = 0;
+    atomic_init(&pool.next_file, 0);
+    atomic_init(&pool.pending, list->num_paths);
+    atomic_init(&pool.failures, 0);
+    assert(pool.workers != NULL && pool.chunks != NULL && pool.free != NULL);
+
+    for (unsigned int i = 0; i < pool.num_chunks; i++) {
+        pool.chunks[i].contents = malloc(PAST_SIZE + options->chunk_size);
+        assert(pool.chunks[i].contents != NULL);
+        pool.free[i] = &pool.chunks[i];
+    }
+
+    for (unsigned int i = 0; i < pool.num_workers; i++) {
+        pool.workers[i].pool = &pool;
+        pool.workers[i].index = i;
+        pool.workers[i].window = malloc(sizeof(window_t));
+        assert(pool.workers[i].window != NULL);
+        pthread_mutex_init(&pool.workers[i].deque.lock, NULL);
+    }
+
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.changed, NULL);
+
+    for (unsigned int i = 1; i < pool.num_workers; i++) {
+        if (pthread_create(&threads[i], NULL, worker_main, &pool.workers[i]) == 0)
+            num_started = i;
+        else
+            break;
+    }
+
+    // The calling thread is the first worker. Workers that could not be started never take a file, so their deques
+    // stay empty.
+    worker_main(&pool.workers[0]);
+
+    for (unsigned int i = 1; i <= num_started; i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.changed);
+
+    for (unsigned int i = 0; i < pool.num_workers; i++) {
+        free(pool.workers[i].window);
+        free(pool.workers[i].deque.tasks);
+        pthread_mutex_destroy(&pool.workers[i].deque.lock);
+    }
+
+    for (unsigned int i = 0; i < pool.num_chunks; i++)
+        free(pool.chunks[i].contents);
+
+    free(pool.chunks);
+    free(pool.free);
+    free(pool.workers);
+    return atomic_load(&pool.failures) > 0;
+}
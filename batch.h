@@ -0,0 +1,44 @@
+/* batch.h
+
+   Compression of many files at once on a work-stealing pool of threads, each file to
+   a file of the same name with the suffix of the output format.
+
+   Zoe Johnston - 2023/06/25
+*/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "stdio.h"
+#include "stdint.h"
+
+/* How every file of a batch is compressed. The dictionary (if dictionary_size is not 0) primes the window for the
+ * start of every file. Files larger than chunk_size are split into chunks which may be compressed by different
+ * threads.
+ */
+typedef struct {
+    int level, format;
+    const uint8_t* dictionary;
+    uint32_t dictionary_size, dictionary_id;
+    unsigned int threads;
+    uint32_t chunk_size;
+} batch_options_t;
+
+/* A growable list of the paths of the files to compress. */
+typedef struct {
+    char** paths;
+    uint32_t num_paths, capacity;
+} file_list_t;
+
+/* Adds path to list. If it is a directory, the files in it are added when recursive is set and it is skipped with a
+ * warning otherwise. Symbolic links are skipped with a warning. Returns 0, or 1 if path could not be added. */
+int file_list_add(file_list_t* list, const char* path, int recursive);
+
+/* Adds every line of manifest to list as a path. Returns 0, or 1 if any path could not be added. */
+int file_list_read(file_list_t* list, FILE* manifest, int recursive);
+
+/* Compresses every file in list, leaving the originals in place. Returns 0 if every file was compressed and 1
+ * otherwise. */
+int compress_batch(file_list_t* list, batch_options_t* options);
+
+#endif
@@ -0,0 +1,105 @@
+/* bench_bitstream.c
+
+   Measures how many bits per second bitstream_t emits, against the original path which
+   pushed one bit at a time and wrote each finished byte with fputc. Run by make bench.
+
+   Zoe Johnston - 2023/06/25
+*/
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "stdint.h"
+#include "time.h"
+#include "output_stream.h"
+
+#define NUM_CODES (1 << 20)
+#define REPEATS 32
+#define MAX_CODE_LENGTH 15
+
+/* The per-bit bitstream this replaced, kept here as the baseline.
+ */
+typedef struct {
+    FILE* output_file;
+    unsigned int bitvec, numbits;
+} bit_at_a_time_t;
+
+static void old_push_bit(bit_at_a_time_t* stream, unsigned int b) {
+    stream->bitvec |= (b & 1) << stream->numbits;
+    stream->numbits++;
+
+    if (stream->numbits == 8) {
+        fputc((unsigned char) stream->bitvec, stream->output_file);
+        stream->bitvec = 0;
+        stream->numbits = 0;
+    }
+}
+
+static void old_push_bits(bit_at_a_time_t* stream, unsigned int b, unsigned int num_bits) {
+    for (unsigned int i = 0; i < num_bits; i++)
+        old_push_bit(stream, (b >> i) & 1);
+}
+
+static double seconds(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/* Pushes the same random codes of 1 to 15 bits (the lengths of prefix codes) LSB first through both paths into 
+ * /dev/null, and prints the rate of each.
+ */
+int main(void) {
+    uint32_t* codes = malloc(NUM_CODES * sizeof(uint32_t));
+    uint8_t* lengths = malloc(NUM_CODES);
+    uint32_t state = 1;
+    uint64_t total_bits = 0;
+    FILE* null = fopen("/dev/null", "wb");
+    bitstream_t* stream = malloc(sizeof(bitstream_t));
+    bit_at_a_time_t old_stream = {null, 0, 0};
+    double start, old_time, new_time;
+
+    if (codes == NULL || lengths == NULL || stream == NULL || null == NULL) {
+        fprintf(stderr, "bench_bitstream: setup failed\n");
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < NUM_CODES; i++) {
+        state = state * 1103515245 + 12345;
+        lengths[i] = 1 + (state >> 16) % MAX_CODE_LENGTH;
+        codes[i] = (state >> 3) & ((1u << lengths[i]) - 1);
+        total_bits += lengths[i];
+    }
+
+    total_bits *= REPEATS;
+
+    start = seconds();
+
+    for (int r = 0; r < REPEATS; r++) {
+        for (uint32_t i = 0; i < NUM_CODES; i++)
+            old_push_bits(&old_stream, codes[i], lengths[i]);
+    }
+
+    fflush(null);
+    old_time = seconds() - start;
+
+    bitstream_init(stream, null);
+    start = seconds();
+
+    for (int r = 0; r < REPEATS; r++) {
+        for (uint32_t i = 0; i < NUM_CODES; i++)
+            bitstream_push_bits(stream, codes[i], lengths[i]);
+    }
+
+    bitstream_finalize(stream);
+    new_time = seconds() - start;
+
+    printf("bench_bitstream: %.0f Mbit pushed as codes of 1 to %d bits\n", total_bits / 1e6, MAX_CODE_LENGTH);
+    printf("  bit at a time with fputc   %8.1f Mbit/s\n", total_bits / old_time / 1e6);
+    printf("  64-bit accumulator         %8.1f Mbit/s (%.1fx)\n", total_bits / new_time / 1e6, old_time / new_time);
+
+    fclose(null);
+    free(codes);
+    free(lengths);
+    free(stream);
+    return 0;
+}
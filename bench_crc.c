@@ -0,0 +1,79 @@
+/* bench_crc.c
+
+   Measures how crc_buffer_parallel scales with the number of threads, and checks that it
+   matches the serial CRC for every thread count. The buffer is 256 MiB, or the number of MiB
+   given as the argument. Run by make bench.
+
+   Zoe Johnston - 2023/06/25
+*/
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "stdint.h"
+#include "time.h"
+#include "unistd.h"
+#include "CRC_for_C.h"
+
+#define DEFAULT_MIB 256
+#define MAX_BENCH_THREADS 64
+#define RUNS 5
+
+static double seconds(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/* Returns the fastest of RUNS checksums of the buffer on num_threads threads (0 for crc_buffer itself), storing the
+ * CRC in the value pointed to by crc.
+ */
+static double time_crc(const uint8_t* data, size_t size, unsigned int num_threads, uint32_t* crc) {
+    double best = 0, start, elapsed;
+
+    for (int run = 0; run < RUNS; run++) {
+        start = seconds();
+        *crc = (num_threads == 0) ? crc_buffer(data, size, 0) : crc_buffer_parallel(data, size, 0, num_threads);
+        elapsed = seconds() - start;
+
+        if (run == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    return best;
+}
+
+/* Checksums the buffer serially, then on 1, 2, 4, ... threads up to twice the number of cores, printing the rate and 
+ * speedup of each. Exits with an error if any CRC differs from the serial one.
+ */
+int main(int argc, char** argv) {
+    size_t size = (size_t) ((argc > 1) ? atoi(argv[1]) : DEFAULT_MIB) << 20;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    uint8_t* data = malloc(size);
+    uint32_t state = 1, serial_crc, crc;
+    double serial_time, elapsed;
+    int mismatches = 0;
+
+    if (data == NULL || size == 0) {
+        fprintf(stderr, "bench_crc: setup failed\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        state = state * 1103515245 + 12345;
+        data[i] = (uint8_t) (state >> 16);
+    }
+
+    serial_time = time_crc(data, size, 0, &serial_crc);
+    printf("bench_crc: %zu MiB, %ld cores online\n", size >> 20, cores);
+    printf("  crc_buffer                 %8.1f MB/s\n", size / serial_time / 1e6);
+
+    for (unsigned int threads = 1; threads <= MAX_BENCH_THREADS && threads <= 2 * cores; threads *= 2) {
+        elapsed = time_crc(data, size, threads, &crc);
+        mismatches += crc != serial_crc;
+        printf("  %2u threads                 %8.1f MB/s (%.2fx)%s\n", threads, size / elapsed / 1e6, 
+            serial_time / elapsed, (crc == serial_crc) ? "" : " CRC DIFFERS");
+    }
+
+    free(data);
+    return (mismatches == 0) ? 0 : 1;
+}
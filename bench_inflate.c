@@ -0,0 +1,235 @@
+/* bench_inflate.c
+
+   Measures the rate at which gzoe -d decompresses, against zlib's inflate and gzip -d. The
+   corpus is 64 MiB (or the number of MiB given as the argument) of synthetic log lines built
+   from a fixed seed, so every run decompresses the same bytes. It is compressed once by zlib
+   at level 6 into bench_inflate.gz, which each decoder then reads from the file and writes to
+   /dev/null. The best of several runs is kept. Run by make bench.
+
+   Zoe Johnston - 2023/06/25
+*/
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "stdint.h"
+#include "string.h"
+#include "time.h"
+#include "fcntl.h"
+#include "unistd.h"
+#include "zlib.h"
+#include "inflate.h"
+#include "deflate.h"
+
+#define DEFAULT_MIB 64
+#define RUNS 5
+#define NUM_WORDS 2048
+#define OUTPUT_SIZE (1 << 20)
+#define COMPRESSED_PATH "bench_inflate.gz"
+
+static double seconds(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static uint32_t next_random(uint32_t* state) {
+    *state = *state * 1103515245 + 12345;
+    return *state >> 8;
+}
+
+/* Fills corpus with lines of a timestamp, a level and words from a fixed vocabulary, where the first words are much
+ * more common than the rest, as in the logs and text the compressor is used on.
+ */
+static void make_corpus(uint8_t* corpus, size_t size) {
+    static const char* levels[4] = {"INFO", "DEBUG", "WARN", "ERROR"};
+    char words[NUM_WORDS][12];
+    char line[512];
+    uint32_t state = 1, rank;
+    size_t used = 0;
+    int length;
+
+    for (int i = 0; i < NUM_WORDS; i++) {
+        length = 2 + next_random(&state) % 9;
+
+        for (int j = 0; j < length; j++)
+            words[i][j] = 'a' + next_random(&state) % 26;
+
+        words[i][length] = '\0';
+    }
+
+    for (uint64_t n = 0; used < size; n++) {
+        length = snprintf(line, sizeof(line), "2023-06-25 %02u:%02u:%02u.%03u %s ", (unsigned int) (n / 3600000) % 24,
+            (unsigned int) (n / 60000) % 60, (unsigned int) (n / 1000) % 60, (unsigned int) n % 1000,
+            levels[next_random(&state) % 4]);
+
+        for (int i = 0, count = 4 + next_random(&state) % 12; i < count; i++) {
+            rank = next_random(&state) % NUM_WORDS;
+            rank = rank * rank / NUM_WORDS * rank / NUM_WORDS;
+            length += snprintf(line + length, sizeof(line) - length, (i % 5 == 4) ? "%s=%u " : "%s ", words[rank],
+                next_random(&state) % 100000);
+        }
+
+        line[length - 1] = '\n';
+        memcpy(corpus + used, line, (size - used < (size_t) length) ? size - used : (size_t) length);
+        used += (size - used < (size_t) length) ? size - used : (size_t) length;
+    }
+}
+
+/* Compresses size bytes of corpus into a gzip file at level 6 with zlib. Returns the compressed size, or 0 if it could
+ * not be written.
+ */
+static size_t write_compressed(const uint8_t* corpus, size_t size) {
+    z_stream stream = {0};
+    uLong bound;
+    uint8_t* compressed;
+    FILE* file;
+    size_t written;
+
+    deflateInit2(&stream, 6, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY);
+    bound = deflateBound(&stream, size);
+    compressed = malloc(bound);
+
+    if (compressed == NULL)
+        return 0;
+
+    stream.next_in = (Bytef*) corpus;
+    stream.avail_in = size;
+    stream.next_out = compressed;
+    stream.avail_out = bound;
+    deflate(&stream, Z_FINISH);
+    written = stream.total_out;
+    deflateEnd(&stream);
+
+    file = fopen(COMPRESSED_PATH, "wb");
+
+    if (file == NULL || fwrite(compressed, 1, written, file) != written || fclose(file) != 0)
+        written = 0;
+
+    free(compressed);
+    return written;
+}
+
+/* Decompresses the file with inflate_stream into output, which checks the CRC and size itself. Returns the time taken.
+ */
+static double time_gzoe(FILE* output) {
+    inflate_options_t options = {FORMAT_GZIP, NULL, 0, 0};
+    int input = open(COMPRESSED_PATH, O_RDONLY);
+    double start = seconds();
+
+    inflate_stream(input, output, &options);
+    close(input);
+    return seconds() - start;
+}
+
+/* Decompresses the file with zlib's inflate into output, a buffer at a time, checking it against the corpus. Returns
+ * the time taken, or a negative time if the output differs.
+ */
+static double time_zlib(FILE* output, const uint8_t* corpus, size_t size) {
+    static uint8_t input[OUTPUT_SIZE], buffer[OUTPUT_SIZE];
+    z_stream stream = {0};
+    FILE* file = fopen(COMPRESSED_PATH, "rb");
+    double start = seconds(), elapsed;
+    size_t produced, total = 0;
+    int result = Z_OK, same = 1;
+
+    inflateInit2(&stream, 31);
+
+    while (result != Z_STREAM_END) {
+        if (stream.avail_in == 0) {
+            stream.next_in = input;
+            stream.avail_in = fread(input, 1, sizeof(input), file);
+
+            if (stream.avail_in == 0)
+                break;
+        }
+
+        stream.next_out = buffer;
+        stream.avail_out = sizeof(buffer);
+        result = inflate(&stream, Z_NO_FLUSH);
+
+        if (result != Z_OK && result != Z_STREAM_END)
+            break;
+
+        produced = sizeof(buffer) - stream.avail_out;
+        fwrite(buffer, 1, produced, output);
+        same &= total + produced <= size && memcmp(buffer, corpus + total, produced) == 0;
+        total += produced;
+    }
+
+    inflateEnd(&stream);
+    fclose(file);
+    elapsed = seconds() - start;
+    return (same && total == size && result == Z_STREAM_END) ? elapsed : -1;
+}
+
+/* Decompresses the file by running gzip -d. Returns the time taken, or a negative time if gzip failed.
+ */
+static double time_gzip(void) {
+    double start = seconds();
+
+    if (system("gzip -dc < " COMPRESSED_PATH " > /dev/null") != 0)
+        return -1;
+
+    return seconds() - start;
+}
+
+/* Returns the lower of best and time, ignoring a negative best (no runs yet).
+ */
+static double fastest(double best, double time) {
+    return (best < 0 || time < best) ? time : best;
+}
+
+/* Builds and compresses the corpus, then decompresses it RUNS times with each decoder and prints the best rate of
+ * each in MB of output per second. Exits with an error if zlib or gzip disagrees with the corpus.
+ */
+int main(int argc, char** argv) {
+    size_t size = (size_t) ((argc > 1) ? atoi(argv[1]) : DEFAULT_MIB) << 20, compressed;
+    uint8_t* corpus = malloc(size);
+    FILE* output = fopen("/dev/null", "wb");
+    double gzoe_time = -1, zlib_time = -1, gzip_time = -1, elapsed;
+    int failed = 0;
+
+    if (corpus == NULL || output == NULL || size == 0) {
+        fprintf(stderr, "bench_inflate: setup failed\n");
+        return 1;
+    }
+
+    make_corpus(corpus, size);
+
+    if ((compressed = write_compressed(corpus, size)) == 0) {
+        perror(COMPRESSED_PATH);
+        return 1;
+    }
+
+    for (int run = 0; run < RUNS; run++) {
+        gzoe_time = fastest(gzoe_time, time_gzoe(output));
+
+        if ((elapsed = time_zlib(output, corpus, size)) < 0)
+            failed = 1;
+        else
+            zlib_time = fastest(zlib_time, elapsed);
+
+        if ((elapsed = time_gzip()) < 0)
+            failed = 1;
+        else
+            gzip_time = fastest(gzip_time, elapsed);
+    }
+
+    printf("bench_inflate: %zu MiB of synthetic logs, %zu bytes as gzip -6 (ratio %.2f)\n", size >> 20, compressed,
+        (double) size / compressed);
+    printf("  gzoe inflate_stream  %8.1f MB/s\n", size / gzoe_time / 1e6);
+
+    if (zlib_time > 0)
+        printf("  zlib inflate         %8.1f MB/s (gzoe is %.2fx)\n", size / zlib_time / 1e6, zlib_time / gzoe_time);
+
+    if (gzip_time > 0)
+        printf("  gzip -d              %8.1f MB/s (gzoe is %.2fx)\n", size / gzip_time / 1e6, gzip_time / gzoe_time);
+
+    if (failed)
+        fprintf(stderr, "bench_inflate: zlib or gzip did not decompress the corpus\n");
+
+    remove(COMPRESSED_PATH);
+    fclose(output);
+    free(corpus);
+    return failed;
+}
@@ -0,0 +1,130 @@
+/* bench_input.c
+
+   Measures the rate at which the input is read and checksummed: one fgetc and crc_continue
+   per byte, as gzoe originally read, against blocks of MAX_BLOCK_SIZE through
+   input_stream_read. The input is 1 GiB (or the number of MiB given as the argument) of
+   synthetic text written into a pipe by another thread. Run by make bench.
+
+   Zoe Johnston - 2023/06/25
+*/
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "stdint.h"
+#include "time.h"
+#include "unistd.h"
+#include "pthread.h"
+#include "input_stream.h"
+#include "deflate.h"
+#include "CRC_for_C.h"
+
+#define PATTERN_SIZE (1 << 20)
+#define DEFAULT_MIB 1024
+
+typedef struct {
+    int fd;
+    const uint8_t* pattern;
+    uint64_t size;
+} writer_t;
+
+static double seconds(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/* Writes size bytes of the pattern, over and over, into the pipe and closes it.
+ */
+static void* write_input(void* arg) {
+    writer_t* writer = arg;
+    uint64_t left = writer->size;
+    ssize_t result;
+
+    while (left > 0) {
+        result = write(writer->fd, writer->pattern, (left < PATTERN_SIZE) ? left : PATTERN_SIZE);
+
+        if (result <= 0)
+            break;
+
+        left -= result;
+    }
+
+    close(writer->fd);
+    return NULL;
+}
+
+/* Points the standard input at a new pipe that another thread fills with size bytes of the pattern.
+ */
+static pthread_t start_writer(writer_t* writer, const uint8_t* pattern, uint64_t size) {
+    int fds[2];
+    pthread_t thread;
+
+    if (pipe(fds) != 0 || dup2(fds[0], STDIN_FILENO) < 0) {
+        perror("bench_input");
+        exit(1);
+    }
+
+    close(fds[0]);
+    writer->fd = fds[1];
+    writer->pattern = pattern;
+    writer->size = size;
+    pthread_create(&thread, NULL, write_input, writer);
+    return thread;
+}
+
+/* Reads the input both ways, checks that the CRCs agree and prints the rate of each.
+ */
+int main(int argc, char** argv) {
+    uint64_t size = (uint64_t) ((argc > 1) ? atoi(argv[1]) : DEFAULT_MIB) << 20, total;
+    uint8_t* pattern = malloc(PATTERN_SIZE);
+    uint8_t* block = malloc(MAX_BLOCK_SIZE);
+    uint32_t state = 1, old_crc = 0;
+    writer_t writer;
+    pthread_t thread;
+    input_stream_t input;
+    double start, old_time, new_time;
+    int c;
+
+    if (pattern == NULL || block == NULL || size == 0) {
+        fprintf(stderr, "bench_input: setup failed\n");
+        return 1;
+    }
+
+    // Words of random lowercase letters, which is what the logs this was written for look like to the CRC
+    for (uint32_t i = 0; i < PATTERN_SIZE; i++) {
+        state = state * 1103515245 + 12345;
+        pattern[i] = ((state >> 16) % 8 == 0) ? ' ' : 'a' + (state >> 20) % 26;
+    }
+
+    thread = start_writer(&writer, pattern, size);
+    start = seconds();
+    total = 0;
+
+    while ((c = fgetc(stdin)) != EOF) {
+        old_crc = (total == 0) ? crc_init((unsigned char) c) : crc_continue((unsigned char) c, old_crc);
+        total++;
+    }
+
+    old_time = seconds() - start;
+    pthread_join(thread, NULL);
+    clearerr(stdin);
+
+    thread = start_writer(&writer, pattern, size);
+    input_stream_init(&input, STDIN_FILENO);
+    start = seconds();
+
+    while (input_stream_read(&input, block, MAX_BLOCK_SIZE) == MAX_BLOCK_SIZE)
+        ;
+
+    new_time = seconds() - start;
+    pthread_join(thread, NULL);
+
+    printf("bench_input: %llu MiB through a pipe, CRCs %s\n", (unsigned long long) (size >> 20),
+        (old_crc == input.crc && total == size) ? "agree" : "DIFFER");
+    printf("  fgetc and crc_continue     %8.1f MB/s\n", size / old_time / 1e6);
+    printf("  input_stream_read          %8.1f MB/s (%.1fx)\n", size / new_time / 1e6, old_time / new_time);
+
+    free(pattern);
+    free(block);
+    return (old_crc == input.crc) ? 0 : 1;
+}
@@ -0,0 +1,279 @@
+/* bench_rsyncable.c
+
+   Measures what --rsyncable costs and what it buys. A corpus is compressed before and after
+   ten scattered edits (a changed byte, an insertion or a deletion, in turn), with and without
+   --rsyncable at levels 1, 6 and 9. Each compressed file is split into chunks of about 4K at
+   content-defined boundaries, as a deduplicating store does, and the dedup hit is the share of
+   the edited output whose chunks the original output already has. The corpus is the file
+   given as the argument, or 8 MiB of synthetic log lines built from a fixed seed. Runs ./gzoe
+   on temporary files in the current directory. Run by make bench.
+
+   Zoe Johnston - 2023/06/25
+*/
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "stdint.h"
+#include "string.h"
+
+#define SYNTHETIC_SIZE (8 << 20)
+#define NUM_WORDS 2048
+#define NUM_EDITS 10
+#define MIN_CHUNK 1024
+#define CHUNK_SHIFT 20
+#define ORIGINAL_PATH "bench_rsyncable.orig"
+#define EDITED_PATH "bench_rsyncable.edit"
+#define OUTPUT_PATH "bench_rsyncable.out"
+
+/* A chunk of compressed output, identified by its size and a 64-bit hash of its contents. */
+typedef struct {
+    uint64_t hash;
+    size_t size;
+} chunk_t;
+
+static uint32_t next_random(uint32_t* state) {
+    *state = *state * 1103515245 + 12345;
+    return *state >> 8;
+}
+
+/* Fills corpus with lines of a timestamp, a level and words from a fixed vocabulary, where the first words are much
+ * more common than the rest.
+ */
+static void make_corpus(uint8_t* corpus, size_t size) {
+    static const char* levels[4] = {"INFO", "DEBUG", "WARN", "ERROR"};
+    char words[NUM_WORDS][12];
+    char line[512];
+    uint32_t state = 1, rank;
+    size_t used = 0, copied;
+    int length;
+
+    for (int i = 0; i < NUM_WORDS; i++) {
+        length = 2 + next_random(&state) % 9;
+
+        for (int j = 0; j < length; j++)
+            words[i][j] = 'a' + next_random(&state) % 26;
+
+        words[i][length] = '\0';
+    }
+
+    for (uint64_t n = 0; used < size; n++) {
+        length = snprintf(line, sizeof(line), "2023-06-25 %02u:%02u:%02u.%03u %s ", (unsigned int) (n / 3600000) % 24,
+            (unsigned int) (n / 60000) % 60, (unsigned int) (n / 1000) % 60, (unsigned int) n % 1000,
+            levels[next_random(&state) % 4]);
+
+        for (int i = 0, count = 4 + next_random(&state) % 12; i < count; i++) {
+            rank = next_random(&state) % NUM_WORDS;
+            rank = rank * rank / NUM_WORDS * rank / NUM_WORDS;
+            length += snprintf(line + length, sizeof(line) - length, (i % 5 == 4) ? "%s=%u " : "%s ", words[rank],
+                next_random(&state) % 100000);
+        }
+
+        line[length - 1] = '\n';
+        copied = (size - used < (size_t) length) ? size - used : (size_t) length;
+        memcpy(corpus + used, line, copied);
+        used += copied;
+    }
+}
+
+/* Reads the whole file at path into a newly allocated buffer, storing its size in the value pointed to by size.
+ * Returns NULL if it cannot be read.
+ */
+static uint8_t* read_whole(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    uint8_t* contents = NULL;
+    size_t capacity = 0, result;
+
+    *size = 0;
+
+    if (file == NULL)
+        return NULL;
+
+    do {
+        if (*size == capacity) {
+            capacity = (capacity == 0) ? (1 << 20) : capacity * 2;
+            contents = realloc(contents, capacity);
+
+            if (contents == NULL)
+                break;
+        }
+
+        result = fread(contents + *size, 1, capacity - *size, file);
+        *size += result;
+    } while (result > 0);
+
+    fclose(file);
+    return contents;
+}
+
+static int write_whole(const char* path, const uint8_t* data, size_t size) {
+    FILE* file = fopen(path, "wb");
+    return file == NULL || fwrite(data, 1, size, file) != size || fclose(file) != 0;
+}
+
+/* Returns a copy of the size bytes of data with NUM_EDITS edits at random places, storing its size in the value
+ * pointed to by edited_size.
+ */
+static uint8_t* edit(const uint8_t* data, size_t size, size_t* edited_size) {
+    static const char inserted[] = "inserted text";
+    uint8_t* edited = malloc(size + NUM_EDITS * sizeof(inserted));
+    uint32_t state = 7;
+    size_t position;
+
+    if (edited == NULL)
+        return NULL;
+
+    memcpy(edited, data, size);
+
+    for (int i = 0; i < NUM_EDITS; i++) {
+        position = ((uint64_t) next_random(&state) << 24 | next_random(&state)) % (size - 16);
+
+        if (i % 3 == 0) {
+            edited[position] ^= 0x55;
+        } else if (i % 3 == 1) {
+            memmove(edited + position + strlen(inserted), edited + position, size - position);
+            memcpy(edited + position, inserted, strlen(inserted));
+            size += strlen(inserted);
+        } else {
+            memmove(edited + position, edited + position + 7, size - position - 7);
+            size -= 7;
+        }
+    }
+
+    *edited_size = size;
+    return edited;
+}
+
+/* Compresses the file at input with ./gzoe and the given options. Returns the output, storing its size in the value
+ * pointed to by size, or NULL if gzoe failed.
+ */
+static uint8_t* compress(const char* input, const char* options, size_t* size) {
+    char command[256];
+
+    snprintf(command, sizeof(command), "./gzoe %s < %s > %s", options, input, OUTPUT_PATH);
+    return (system(command) == 0) ? read_whole(OUTPUT_PATH, size) : NULL;
+}
+
+static uint64_t hash_bytes(const uint8_t* data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+
+    return hash;
+}
+
+static int compare_chunks(const void* a, const void* b) {
+    const chunk_t* x = a;
+    const chunk_t* y = b;
+
+    if (x->hash != y->hash)
+        return (x->hash < y->hash) ? -1 : 1;
+
+    return (x->size < y->size) ? -1 : (x->size > y->size);
+}
+
+/* Splits the size bytes of data where a gear hash of the bytes before has its top 12 bits clear, at least MIN_CHUNK
+ * bytes apart, into chunks. Returns them, storing their number in the value pointed to by num_chunks.
+ */
+static chunk_t* split(const uint8_t* data, size_t size, size_t* num_chunks) {
+    static uint32_t gear[256];
+    chunk_t* chunks = malloc((size / MIN_CHUNK + 1) * sizeof(chunk_t));
+    uint32_t state = 1, hash = 0;
+    size_t start = 0;
+
+    for (int i = 0; i < 256; i++)
+        gear[i] = next_random(&state) << 8 ^ next_random(&state);
+
+    *num_chunks = 0;
+
+    for (size_t i = 0; i < size && chunks != NULL; i++) {
+        hash = (hash << 1) + gear[data[i]];
+
+        if (i + 1 == size || (i + 1 - start >= MIN_CHUNK && (hash >> CHUNK_SHIFT) == 0)) {
+            chunks[*num_chunks].hash = hash_bytes(data + start, i + 1 - start);
+            chunks[(*num_chunks)++].size = i + 1 - start;
+            start = i + 1;
+        }
+    }
+
+    return chunks;
+}
+
+/* Returns the share of the bytes of edited whose chunks are also chunks of original.
+ */
+static double dedup_hit(const uint8_t* original, size_t original_size, const uint8_t* edited, size_t edited_size) {
+    size_t num_known, num_new, hit = 0;
+    chunk_t* known = split(original, original_size, &num_known);
+    chunk_t* fresh = split(edited, edited_size, &num_new);
+
+    qsort(known, num_known, sizeof(chunk_t), compare_chunks);
+
+    for (size_t i = 0; i < num_new; i++) {
+        if (bsearch(&fresh[i], known, num_known, sizeof(chunk_t), compare_chunks) != NULL)
+            hit += fresh[i].size;
+    }
+
+    free(known);
+    free(fresh);
+    return (double) hit / edited_size;
+}
+
+/* Writes the corpus and its edited copy, compresses both at each level with and without --rsyncable and prints the
+ * size of each output and its dedup hit. Exits with an error if gzoe fails.
+ */
+int main(int argc, char** argv) {
+    static const char* levels[3] = {"-1", "-6", "-9"};
+    size_t size, edited_size, original_size, new_size, plain_size = 0;
+    uint8_t* corpus = (argc > 1) ? read_whole(argv[1], &size) : malloc(size = SYNTHETIC_SIZE);
+    uint8_t* edited;
+    uint8_t* original;
+    uint8_t* changed;
+    char options[64];
+    int failed = 0;
+
+    if (corpus == NULL || size < 1024) {
+        fprintf(stderr, "bench_rsyncable: cannot read a corpus of at least 1K\n");
+        return 1;
+    }
+
+    if (argc <= 1)
+        make_corpus(corpus, size);
+
+    edited = edit(corpus, size, &edited_size);
+
+    if (edited == NULL || write_whole(ORIGINAL_PATH, corpus, size) || write_whole(EDITED_PATH, edited, edited_size)) {
+        perror("bench_rsyncable");
+        return 1;
+    }
+
+    printf("bench_rsyncable: %zu bytes of %s with %d edits\n", size, (argc > 1) ? argv[1] : "synthetic logs",
+        NUM_EDITS);
+
+    for (int i = 0; i < 6 && !failed; i++) {
+        snprintf(options, sizeof(options), "%s%s", levels[i / 2], (i % 2) ? " --rsyncable" : "");
+        original = compress(ORIGINAL_PATH, options, &original_size);
+        changed = compress(EDITED_PATH, options, &new_size);
+
+        if (original == NULL || changed == NULL) {
+            fprintf(stderr, "bench_rsyncable: ./gzoe %s failed\n", options);
+            failed = 1;
+        } else if (i % 2 == 0) {
+            plain_size = original_size;
+            printf("  %-16s %10zu bytes          dedup hit %5.1f%%\n", options, original_size,
+                100 * dedup_hit(original, original_size, changed, new_size));
+        } else {
+            printf("  %-16s %10zu bytes (%+.1f%%) dedup hit %5.1f%%\n", options, original_size,
+                100.0 * original_size / plain_size - 100, 100 * dedup_hit(original, original_size, changed, new_size));
+        }
+
+        free(original);
+        free(changed);
+    }
+
+    remove(ORIGINAL_PATH);
+    remove(EDITED_PATH);
+    remove(OUTPUT_PATH);
+    free(corpus);
+    free(edited);
+    return failed;
+}
@@ -0,0 +1,25 @@
+/* crc_test.c
+
+   Checks every CRC kernel the CPU supports against the table-driven CRC from CRC.h,
+   over random lengths at every alignment. Run by make check.
+
+   Zoe Johnston - 2023/06/25
+*/
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "time.h"
+#include "CRC_for_C.h"
+
+#define LENGTHS_PER_ALIGNMENT 1000
+
+/* Runs the self test with the seed given as the only argument, or a new one from the clock, which is printed so that a 
+ * failure can be repeated. Exits with an error if any CRC was wrong.
+ */
+int main(int argc, char** argv) {
+    unsigned int seed = (argc > 1) ? strtoul(argv[1], NULL, 10) : (unsigned int) time(NULL);
+    int failures = crc_self_test(seed, LENGTHS_PER_ALIGNMENT);
+
+    printf("crc_test: seed %u, %d mismatches\n", seed, failures);
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,480 @@
+/* deflate.c
+
+   Definitions of the functions declared in deflate.h
+
+   Writes LZSS output as DEFLATE blocks of type 0, 1 or 2, along with the headers of
+   the gzip and zlib formats. Based on code by Bill Bird for outputting blocks of type 0
+   in Gzip format.
+
+   Zoe Johnston - 2023/06/25
+*/
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "assert.h"
+#include "stdint.h"
+#include "output_stream.h"
+#include "lzss.h"
+#include "prefix_code.h"
+#include "deflate.h"
+
+/* A prefix code (stored bit-reversed) together with any offset bits that follow it, ready to be pushed
+ * LSB first. code_bits is the length of the prefix code alone and num_bits the length of the whole word.
+ */
+typedef struct {
+    uint32_t word;
+    uint16_t code_bits;
+    uint16_t num_bits;
+} code_word_t;
+
+/* Global Variables */
+
+uint16_t ll_code_table[2][288];
+uint16_t dist_code_table[2][32];
+code_word_t default_length_words[259];
+code_word_t default_dist_words[30];
+
+/* Function Declaration */
+
+/* Pushes a basic gzip header. The extra flags mark output of the fastest and slowest compression levels as gzip does.
+ * Code by Bill Bird. 
+ */
+void push_gzip_header(bitstream_t* stream, int level) {
+    unsigned char initial_bytes[] = {0x1f, 0x8b,
+        0x08,
+        0x00, 
+        0x00, 0x00, 0x00, 0x00,
+        (level == MAX_LEVEL) ? 0x02 : (level == MIN_LEVEL) ? 0x04 : 0x00,
+        0x03 
+    };
+
+    for(unsigned int i = 0; i < 10; i++)
+        bitstream_push_byte(stream, initial_bytes[i]);
+}
+
+/* Pushes the header of a BGZF member: a gzip header with an extra field holding a "BC" subfield, which gives the size 
+ * of the whole member less one so that readers can skip from member to member without decompressing.
+ */
+void push_bgzf_header(bitstream_t* stream, int level, uint32_t member_size) {
+    unsigned char initial_bytes[] = {0x1f, 0x8b,
+        0x08,
+        0x04, 
+        0x00, 0x00, 0x00, 0x00,
+        (level == MAX_LEVEL) ? 0x02 : (level == MIN_LEVEL) ? 0x04 : 0x00,
+        0xff,
+        0x06, 0x00,
+        'B', 'C', 0x02, 0x00
+    };
+
+    for (unsigned int i = 0; i < 16; i++)
+        bitstream_push_byte(stream, initial_bytes[i]);
+
+    bitstream_push_u16(stream, member_size - 1);
+}
+
+/* Pushes the empty BGZF member which marks the end of the file.
+ */
+void push_bgzf_eof(bitstream_t* stream) {
+    push_bgzf_header(stream, DEFAULT_LEVEL, BGZF_EOF_SIZE);
+
+    // A final block of type 1 holding only the end of block code, then the CRC and size of nothing
+    bitstream_push_u16(stream, 0x0003);
+    bitstream_push_u32(stream, 0);
+    bitstream_push_u32(stream, 0);
+}
+
+/* Pushes a zlib header (RFC 1950) for a 32K window. If has_dictionary is set, the FDICT flag is set and the Adler-32 
+ * checksum of the dictionary follows, so that a decoder can tell which dictionary it needs.
+ */
+void push_zlib_header(bitstream_t* stream, int level, int has_dictionary, uint32_t dictionary_id) {
+    uint32_t cmf = 0x78;
+    uint32_t flevel = (level == MIN_LEVEL) ? 0 : (level < DEFAULT_LEVEL) ? 1 : (level == DEFAULT_LEVEL) ? 2 : 3;
+    uint32_t flg = (flevel << 6) | (has_dictionary ? 0x20 : 0);
+
+    // FCHECK makes the two bytes a multiple of 31
+    flg += 31 - ((cmf << 8) | flg) % 31;
+
+    bitstream_push_byte(stream, cmf);
+    bitstream_push_byte(stream, flg);
+
+    if (has_dictionary)
+        bitstream_push_u32_be(stream, dictionary_id);
+}
+
+/* Pushes the header of the given format, which is nothing for raw DEFLATE. The zlib header names the dictionary if 
+ * dictionary_size is not 0.
+ */
+void push_header(bitstream_t* stream, int format, int level, uint32_t dictionary_size, uint32_t dictionary_id) {
+    if (format == FORMAT_GZIP)
+        push_gzip_header(stream, level);
+    else if (format == FORMAT_ZLIB)
+        push_zlib_header(stream, level, dictionary_size > 0, dictionary_id);
+}
+
+/* Pads the stream to a byte boundary, then pushes the trailer of the given format: the CRC-32 and size of the input 
+ * for gzip, its Adler-32 checksum for zlib and nothing for raw DEFLATE.
+ */
+void push_trailer(bitstream_t* stream, int format, uint32_t crc, uint32_t adler, uint32_t size) {
+    bitstream_flush_to_byte(stream);
+
+    if (format == FORMAT_GZIP) {
+        bitstream_push_u32(stream, crc);
+        bitstream_push_u32(stream, size);
+    } else if (format == FORMAT_ZLIB) {
+        bitstream_push_u32_be(stream, adler);
+    }
+}
+
+/* Fills words with the length symbol code and length offset bits for every match length from 3 to 258.
+ */
+void setup_length_words(code_word_t words[259], uint16_t ll_code[], uint16_t ll_code_lengths[]) {
+    uint16_t symbol, code_bits, extra_bits, end;
+
+    for (unsigned int i = 0; i < 29; i++) {
+        symbol = i + 257;
+        code_bits = ll_code_lengths[symbol];
+        extra_bits = offset_bits(symbol);
+        end = (i < 28) ? length_code_ranges[i + 1] : 259;
+
+        for (unsigned int length = length_code_ranges[i]; length < end; length++) {
+            words[length].word = ll_code[symbol] | ((length - length_code_ranges[i]) << code_bits);
+            words[length].code_bits = code_bits;
+            words[length].num_bits = code_bits + extra_bits;
+        }
+    }
+}
+
+/* Fills words with the code for every distance symbol. The distance offset is shifted in above the code
+ * when the word is pushed.
+ */
+void setup_dist_words(code_word_t words[30], uint16_t dist_code[], uint16_t dist_code_lengths[]) {
+    for (unsigned int symbol = 0; symbol < 30; symbol++) {
+        words[symbol].word = dist_code[symbol];
+        words[symbol].code_bits = dist_code_lengths[symbol];
+        words[symbol].num_bits = dist_code_lengths[symbol] + offset_bits(symbol);
+    }
+}
+
+/* Pushes a single token of a block of type 1 or 2. Backreferences are pushed as one word for the length
+ * and one word for the distance. See token_t in lzss.h to see how tokens are stored.
+ */
+static inline void push_token(bitstream_t* stream, token_t token, uint16_t ll_code[], uint16_t ll_code_lengths[], 
+    code_word_t length_words[], code_word_t dist_words[]) {
+    uint16_t distance = TOKEN_DISTANCE(token), symbol;
+    code_word_t* dist_word;
+
+    if (distance == 0) {
+        bitstream_push_bits(stream, ll_code[token], ll_code_lengths[token]);
+        return;
+    }
+
+    bitstream_push_bits(stream, length_words[TOKEN_LENGTH(token)].word, length_words[TOKEN_LENGTH(token)].num_bits);
+
+    symbol = distance_to_symbol(distance);
+    dist_word = &dist_words[symbol];
+    bitstream_push_bits(stream, dist_word->word | ((uint32_t) (distance - distance_code_ranges[symbol]) << dist_word->code_bits), 
+        dist_word->num_bits);
+}
+
+/* Sets up the global code tables used for block type 1, storing them in a global variable.
+ */
+void setup_default_code_tables() {
+    unsigned int i; 
+
+    for (i = 0; i < 144; i++) 
+        ll_code_table[1][i] = 8;
+    for (i = 144; i < 256; i++) 
+        ll_code_table[1][i] = 9;
+    for (i = 256; i < 280; i++) 
+        ll_code_table[1][i] = 7;
+    for (i = 280; i < 288; i++) 
+        ll_code_table[1][i] = 8;
+    for (i = 0; i < 32; i++) 
+        dist_code_table[1][i] = 5;
+
+    construct_canonical_code(288, ll_code_table[1], ll_code_table[0]);
+    construct_canonical_code(32, dist_code_table[1], dist_code_table[0]);
+
+    setup_length_words(default_length_words, ll_code_table[0], ll_code_table[1]);
+    setup_dist_words(default_dist_words, dist_code_table[0], dist_code_table[1]);
+}
+
+/* Counts the number of code lengths which are not trailing zeros, assuming that the first offset amount of them
+ * are not trailing zeros.
+ */
+uint16_t count_codes(uint16_t code_lengths[], uint16_t num_codes, uint16_t offset) {
+    uint16_t count = 0, num = 0;
+
+    for (unsigned int i = offset; i < num_codes; i++) {
+        count++;
+        
+        if (code_lengths[i] != 0)
+            num = count;
+    }
+
+    return num + offset;
+}
+
+/* Counts the number of code lengths which are not trailing zeros, assuming that the first offset amount of them
+ * are not trailing zeros. Applies a permutation as this is done.
+ */
+uint16_t count_cl_codes(uint16_t code_lengths[], uint16_t num_codes, uint16_t permutation[], uint16_t offset) {
+    uint16_t count = 0, num = 0;
+
+    for (unsigned int i = offset; i < num_codes; i++) {
+        count++;
+        
+        if (code_lengths[permutation[i]] != 0)
+            num = count;
+    }
+
+    return num + offset;
+}
+
+/* Applies RLE to code lengths using CL symbols 16, 17, and 18
+ */
+uint16_t rle(uint16_t num_codes, uint16_t code_lengths[], uint16_t storage[]) {
+    uint16_t i = 0, j = 0, length, current;
+
+    while (i < num_codes) {
+        current = code_lengths[i];
+
+        // Checks for a run of three zeros
+        if (current == 0 && i + 2 < num_codes && code_lengths[i + 1] == 0 && code_lengths[i + 2] == 0) {
+            length = 3;
+            
+            while (length + i < num_codes) {
+                if (code_lengths[length + i] != 0)
+                    break;
+
+                if (length == 138)
+                    break;
+
+                length++;
+            }
+            
+            if (length < 11) {
+                storage[j] = 17;
+                storage[j + 1] = length - 3;
+            } else {
+                storage[j] = 18;
+                storage[j + 1] = length - 11;
+            }
+
+            j += 2;
+            i += length;
+
+        // Checks for a run of three of the current character
+        } else if (i + 3 < num_codes && current == code_lengths[i + 1] 
+        && current == code_lengths[i + 2] && current == code_lengths[i + 3]) {
+            storage[j] = current;
+            length = 3;
+            
+            while (length + i + 1 < num_codes) {
+                if (code_lengths[length + i + 1] != current)
+                    break;
+
+                if (length == 6)
+                    break;
+
+                length++;
+            }
+
+            storage[j + 1] = 16;
+            storage[j + 2] = length - 3;
+
+            j += 3;
+            i += length + 1;
+        
+        } else {
+            storage[j] = current;
+
+            j++;
+            i++;
+        }
+    }
+
+    return j;
+}
+
+/* Writes the code length data.
+ */
+void write_cl_data(bitstream_t* stream, uint16_t ll_code_lengths[], uint16_t num_ll_codes, uint16_t dist_code_lengths[], uint16_t num_dist_codes) {
+    // Cutting off ending runs of zeros
+    num_ll_codes = count_codes(ll_code_lengths, num_ll_codes, 257);
+    num_dist_codes = count_codes(dist_code_lengths, num_dist_codes, 1);
+
+    unsigned int HLIT = num_ll_codes - 257;
+    unsigned int HDIST = num_dist_codes - 1;
+    
+    bitstream_push_bits(stream, HLIT,  5);
+    bitstream_push_bits(stream, HDIST, 5);
+
+    // Applying RLE using CL Symbols 16, 17, and 18
+    uint16_t new_ll_code_lengths[286] = {0};
+    uint16_t new_dist_code_lengths[30] = {0};
+    num_ll_codes = rle(num_ll_codes, ll_code_lengths, new_ll_code_lengths);
+    num_dist_codes = rle(num_dist_codes, dist_code_lengths, new_dist_code_lengths);
+
+    // Computing CL code
+    uint32_t frequencies[19] = {0};
+    get_cl_frequencies(frequencies, new_ll_code_lengths, num_ll_codes, new_dist_code_lengths, num_dist_codes);
+    
+    uint16_t cl_code[19];
+    uint16_t cl_code_lengths[19] = {0};
+    uint16_t cl_permutation[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    package_merge(7, 19, frequencies, cl_code_lengths);
+    construct_canonical_code(19, cl_code_lengths, cl_code);
+
+    // Cutting off ending runs of zeros
+    uint16_t num_cl_codes = count_cl_codes(cl_code_lengths, 19, cl_permutation, 4);
+    unsigned int HCLEN = num_cl_codes - 4; 
+    bitstream_push_bits(stream, HCLEN, 4);
+
+    // Pushing CL code
+    for (unsigned int i = 0; i < num_cl_codes; i++)
+        bitstream_push_bits(stream, cl_code_lengths[cl_permutation[i]], 3);
+    
+    uint16_t bits, code, len, offset;
+
+    // Pushing encoded ll code
+    // See rle to see how offsets are stored
+    for (unsigned int k = 0; k < num_ll_codes; k++) {
+        len = new_ll_code_lengths[k];
+        bits = cl_code_lengths[len];
+        code = cl_code[len];
+        bitstream_push_bits(stream, code, bits);
+
+        if (len > 15) {
+            k++;
+            offset = new_ll_code_lengths[k];
+        }
+
+        if (len == 16) {
+            bitstream_push_bits(stream, offset, 2);
+        } else if (len == 17) {
+            bitstream_push_bits(stream, offset, 3);
+        } else if (len == 18) {
+            bitstream_push_bits(stream, offset, 7);
+        }
+    }
+
+    // Pushing encoded distance code
+    if (num_dist_codes == 0) {
+        bitstream_push_bits(stream,0,5);
+
+    } else {
+        for (unsigned int k = 0; k < num_dist_codes; k++) {
+            len = new_dist_code_lengths[k];
+            bits = cl_code_lengths[len];
+            code = cl_code[len];
+            bitstream_push_bits(stream, code, bits);
+
+            if (len > 15) {
+                k++;
+                offset = new_dist_code_lengths[k];
+            }
+
+            if (len == 16) {
+                bitstream_push_bits(stream, offset, 2);
+            } else if (len == 17) {
+                bitstream_push_bits(stream, offset, 3);
+            } else if (len == 18) {
+                bitstream_push_bits(stream, offset, 7);
+            }
+        }
+    }
+}
+
+/* Pushes a block of type 2.
+ */
+void block_2(bitstream_t* stream, token_t* contents, uint32_t block_size, uint32_t* ll_frequencies, uint32_t* dist_frequencies){
+    uint16_t ll_code_lengths[286] = {0}, ll_code[286];
+    uint16_t dist_code_lengths[30] = {0}, dist_code[30];
+
+    bitstream_push_bits(stream, 2, 2); 
+
+    package_merge(15, 286, ll_frequencies, ll_code_lengths);
+    package_merge(15, 30, dist_frequencies, dist_code_lengths);
+
+    construct_canonical_code(286, ll_code_lengths, ll_code);
+    construct_canonical_code(30, dist_code_lengths, dist_code);
+
+    write_cl_data(stream, ll_code_lengths, 286, dist_code_lengths, 30);
+
+    code_word_t length_words[259], dist_words[30];
+    setup_length_words(length_words, ll_code, ll_code_lengths);
+    setup_dist_words(dist_words, dist_code, dist_code_lengths);
+
+    for (uint32_t index = 0; index < block_size; index++)
+        push_token(stream, contents[index], ll_code, ll_code_lengths, length_words, dist_words);
+
+    bitstream_push_bits(stream, ll_code[256], ll_code_lengths[256]);
+}
+
+/* Pushes a block of type 1.
+ */
+void block_1(bitstream_t* stream, token_t* contents, uint32_t block_size) {
+    bitstream_push_bits(stream, 1, 2);
+
+    for (uint32_t index = 0; index < block_size; index++)
+        push_token(stream, contents[index], ll_code_table[0], ll_code_table[1], default_length_words, default_dist_words);
+
+    bitstream_push_bits(stream, ll_code_table[0][256], ll_code_table[1][256]);
+}
+
+/* Pushes a block of type 0. Code by Bill Bird.
+ */
+uint32_t block_0(bitstream_t* stream, uint8_t* contents, uint32_t block_size) {
+    bitstream_push_bits(stream, 0, 2);
+    bitstream_flush_to_byte(stream);
+    bitstream_push_u16(stream, block_size);
+    bitstream_push_u16(stream, ~block_size);
+
+    for(unsigned int i = 0; i < block_size; i++)
+        bitstream_push_byte(stream, contents[i]); 
+
+    return 0;
+}
+
+/* Pushes an empty, non-final block of type 0. This ends the output at a byte boundary, so that it can be followed by 
+ * DEFLATE data which was compressed separately, as zlib does for Z_SYNC_FLUSH.
+ */
+void push_sync_flush(bitstream_t* stream) {
+    bitstream_push_bit(stream, 0);
+    block_0(stream, NULL, 0);
+}
+
+/* Checks if the LZSS output of a block is an improvement on its contents. If it isn't, uses block type 0. If it is, 
+ * then a freqeuncy count is performed. The results of the frequency count are then used to decide if using block type 
+ * 2 will be advantageous.
+ */
+void encode_block(bitstream_t* stream, uint8_t* contents, uint32_t block_size, token_t* tokens, uint32_t num_tokens, 
+    uint32_t bits_used) {
+    if (bits_used > (block_size * 8) + 40) {
+        block_0(stream, contents, block_size);
+        return;
+    }
+
+    uint32_t ll_frequencies[288] = {0};
+    uint32_t dist_frequencies[32] = {0};
+    get_frequencies(ll_frequencies, dist_frequencies, tokens, num_tokens);
+
+    if (frequency_analysis(ll_frequencies, dist_frequencies) == 1) {
+        block_1(stream, tokens, num_tokens);
+        return;
+    }
+
+    block_2(stream, tokens, num_tokens, ll_frequencies, dist_frequencies);
+}
+
+/* Preforms LZSS on a block, then encodes it.
+ */
+uint32_t write_block(bitstream_t* stream, window_t* window, uint8_t* contents, uint32_t block_size) {
+    uint32_t bits_used;
+    token_t post_lzss_contents[MAX_BLOCK_SIZE];
+    uint32_t post_lzss_size = lzss(post_lzss_contents, window, contents, block_size, &bits_used);
+
+    encode_block(stream, contents, block_size, post_lzss_contents, post_lzss_size, bits_used);
+    return 0;
+}
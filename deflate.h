@@ -0,0 +1,42 @@
+/* deflate.h
+
+   Writing of DEFLATE blocks and of the gzip and zlib headers around them.
+
+   Zoe Johnston - 2023/06/25
+*/
+
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include "stdio.h"
+#include "stdint.h"
+#include "output_stream.h"
+#include "lzss.h"
+
+#define MAX_BLOCK_SIZE ((1 << 16) - 1)
+
+#define FORMAT_GZIP 0
+#define FORMAT_ZLIB 1
+#define FORMAT_RAW 2
+#define FORMAT_BGZF 3
+
+// The most input in one BGZF member, chosen by the format so that a member never exceeds 64K even if it is stored
+#define BGZF_BLOCK_SIZE 0xff00
+#define BGZF_MAX_MEMBER_SIZE 0x10000
+#define BGZF_HEADER_SIZE 18
+#define BGZF_EOF_SIZE 28
+
+void push_gzip_header(bitstream_t* stream, int level);
+void push_bgzf_header(bitstream_t* stream, int level, uint32_t member_size);
+void push_bgzf_eof(bitstream_t* stream);
+void push_zlib_header(bitstream_t* stream, int level, int has_dictionary, uint32_t dictionary_id);
+void push_header(bitstream_t* stream, int format, int level, uint32_t dictionary_size, uint32_t dictionary_id);
+void push_trailer(bitstream_t* stream, int format, uint32_t crc, uint32_t adler, uint32_t size);
+void setup_default_code_tables();
+uint32_t block_0(bitstream_t* stream, uint8_t* contents, uint32_t block_size);
+void push_sync_flush(bitstream_t* stream);
+void encode_block(bitstream_t* stream, uint8_t* contents, uint32_t block_size, token_t* tokens, uint32_t num_tokens, 
+    uint32_t bits_used);
+uint32_t write_block(bitstream_t* stream, window_t* window, uint8_t* contents, uint32_t block_size);
+
+#endif
@@ -1,6 +1,6 @@
 /* gzoe.c
 
-   Oversees collection of input into blocks and block writing.
+   Oversees collection of input into blocks, which are written by deflate.c.
    Based on code by Bill Bird for outputting blocks of type 0 in Gzip format.
 
    Zoe Johnston - 2023/06/25
@@ -10,434 +10,276 @@
 #include "stdlib.h"
 #include "assert.h"
 #include "stdint.h"
+#include "string.h"
+#include "unistd.h"
 #include "output_stream.h"
+#include "input_stream.h"
 #include "lzss.h"
 #include "prefix_code.h"
 #include "CRC_for_C.h"
-
-#define MAX_BLOCK_SIZE (1<<16) - 1
-
-/* Global Variables */
-
-uint16_t ll_code_table[2][288];
-uint16_t dist_code_table[2][32];
-
-/* Function Declaration */
-
-/* Pushes a basic gzip header. Code by Bill Bird. 
+#include "adler32.h"
+#include "deflate.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include "batch.h"
+#include "inflate.h"
+
+/* Options given on the command line. format is the container the DEFLATE stream is wrapped in. dictionary is the 
+ * path of a preset dictionary, or NULL. threads is the number of threads compressing chunks of chunk_size bytes, or 0 
+ * to compress the whole input as one stream through the pipeline. verbose prints the pipeline's waiting times and 
+ * rsyncable makes it reset at content-defined boundaries. paths 
+ * are the files (and with recursive, directories) to compress instead of the standard input, to which manifest adds 
+ * the paths listed on the standard input. decompress reads the format from the input instead of writing it.
  */
-void push_gzip_header(bitstream_t* stream) {
-    unsigned char initial_bytes[] = {0x1f, 0x8b,
-        0x08,
-        0x00, 
-        0x00, 0x00, 0x00, 0x00,
-        0x00,
-        0x03 
-    };
-
-    for(unsigned int i = 0; i < 10; i++)
-        bitstream_push_byte(stream, initial_bytes[i]);
-}
-
-/* Sets up the global code tables used for block type 1, storing them in a global variable.
+typedef struct {
+    int level;
+    int format;
+    char* dictionary;
+    unsigned int threads;
+    uint32_t chunk_size;
+    int verbose, rsyncable;
+    char** paths;
+    int num_paths;
+    int recursive, manifest;
+    int decompress;
+} options_t;
+
+/* Prints how to use the compressor and exits with an error.
  */
-void setup_default_code_tables() {
-    unsigned int i; 
-
-    for (i = 0; i < 144; i++) 
-        ll_code_table[1][i] = 8;
-    for (i = 144; i < 256; i++) 
-        ll_code_table[1][i] = 9;
-    for (i = 256; i < 280; i++) 
-        ll_code_table[1][i] = 7;
-    for (i = 280; i < 288; i++) 
-        ll_code_table[1][i] = 8;
-    for (i = 0; i < 32; i++) 
-        dist_code_table[1][i] = 5;
-
-    construct_canonical_code(288, ll_code_table[1], ll_code_table[0]);
-    construct_canonical_code(32, dist_code_table[1], dist_code_table[0]);
+void usage(char* name) {
+    fprintf(stderr, "Usage: %s [-1 ... -9] [--zlib | --raw | --bgzf] [-D dictionary] [-v]\n"
+        "       [--rsyncable | -p threads [-b KiB]] < input > output\n", name);
+    fprintf(stderr, "       %s [options] [-r] [--manifest] file ...\n", name);
+    fprintf(stderr, "       %s -d [--zlib | --raw] [-D dictionary] < input > output\n", name);
+    fprintf(stderr, "  -1 compresses fastest, -9 compresses best (default -%d)\n", DEFAULT_LEVEL);
+    fprintf(stderr, "  --zlib writes zlib (RFC 1950) instead of gzip, --raw writes bare DEFLATE\n");
+    fprintf(stderr, "  --bgzf writes independent gzip members of up to 64K, which can be decompressed in parallel\n");
+    fprintf(stderr, "  -D primes the window with up to 32K of a preset dictionary (zlib unless --raw)\n");
+    fprintf(stderr, "  -v prints how long each stage of the pipeline waited for the others\n");
+    fprintf(stderr, "  --rsyncable restarts at boundaries chosen by the content, so edits only change nearby output\n");
+    fprintf(stderr, "  -p compresses chunks of the input on 1 to %d threads\n", MAX_THREADS);
+    fprintf(stderr, "  -b sets the chunk size from %d to %d KiB (default %d)\n", MIN_CHUNK_SIZE / 1024, 
+        MAX_CHUNK_SIZE / 1024, DEFAULT_CHUNK_SIZE / 1024);
+    fprintf(stderr, "  files are compressed to files with the suffix .gz, .zz or .deflate, on -p threads\n");
+    fprintf(stderr, "  -r compresses the files in directories, --manifest the files listed on the input\n");
+    fprintf(stderr, "  -d decompresses gzip (any number of members, as in BGZF), zlib or raw DEFLATE\n");
+    exit(1);
 }
 
-/* Counts the number of code lengths which are not trailing zeros, assuming that the first offset amount of them
- * are not trailing zeros.
+/* Parses a whole decimal number between min and max, exiting with the usage message if arg is not one.
  */
-uint16_t count_codes(uint16_t code_lengths[], uint16_t num_codes, uint16_t offset) {
-    uint16_t count = 0, num = 0;
-
-    for (unsigned int i = offset; i < num_codes; i++) {
-        count++;
-        
-        if (code_lengths[i] != 0)
-            num = count;
-    }
+unsigned long parse_number(char* arg, unsigned long min, unsigned long max, char* name) {
+    char* end;
+    unsigned long value = strtoul(arg, &end, 10);
 
-    return num + offset;
-}
+    if (arg[0] < '0' || arg[0] > '9' || *end != '\0' || value < min || value > max)
+        usage(name);
 
-/* Counts the number of code lengths which are not trailing zeros, assuming that the first offset amount of them
- * are not trailing zeros. Applies a permutation as this is done.
- */
-uint16_t count_cl_codes(uint16_t code_lengths[], uint16_t num_codes, uint16_t permutation[], uint16_t offset) {
-    uint16_t count = 0, num = 0;
-
-    for (unsigned int i = offset; i < num_codes; i++) {
-        count++;
-        
-        if (code_lengths[permutation[i]] != 0)
-            num = count;
-    }
-
-    return num + offset;
+    return value;
 }
 
-/* Applies RLE to code lengths using CL symbols 16, 17, and 18
+/* Parses the command line into options, exiting with the usage message if it is not valid.
  */
-uint16_t rle(uint16_t num_codes, uint16_t code_lengths[], uint16_t storage[]) {
-    uint16_t i = 0, j = 0, length, current;
-
-    while (i < num_codes) {
-        current = code_lengths[i];
-
-        // Checks for a run of three zeros
-        if (current == 0 && i + 2 < num_codes && code_lengths[i + 1] == 0 && code_lengths[i + 2] == 0) {
-            length = 3;
-            
-            while (length + i < num_codes) {
-                if (code_lengths[length + i] != 0)
-                    break;
-
-                if (length == 138)
-                    break;
-
-                length++;
-            }
-            
-            if (length < 11) {
-                storage[j] = 17;
-                storage[j + 1] = length - 3;
-            } else {
-                storage[j] = 18;
-                storage[j + 1] = length - 11;
-            }
-
-            j += 2;
-            i += length;
-
-        // Checks for a run of three of the current character
-        } else if (i + 3 < num_codes && current == code_lengths[i + 1] 
-        && current == code_lengths[i + 2] && current == code_lengths[i + 3]) {
-            storage[j] = current;
-            length = 3;
-            
-            while (length + i + 1 < num_codes) {
-                if (code_lengths[length + i + 1] != current)
-                    break;
-
-                if (length == 6)
-                    break;
-
-                length++;
-            }
+void parse_options(options_t* options, int argc, char** argv) {
+    char* arg;
+
+    options->level = DEFAULT_LEVEL;
+    options->format = FORMAT_GZIP;
+    options->dictionary = NULL;
+    options->threads = 0;
+    options->chunk_size = DEFAULT_CHUNK_SIZE;
+    options->verbose = 0;
+    options->rsyncable = 0;
+    options->paths = malloc(argc * sizeof(char*));
+    assert(options->paths != NULL);
+    options->num_paths = 0;
+    options->recursive = 0;
+    options->manifest = 0;
+    options->decompress = 0;
+
+    for (int i = 1; i < argc; i++) {
+        arg = argv[i];
+
+        if (arg[0] == '-' && arg[1] >= '0' + MIN_LEVEL && arg[1] <= '0' + MAX_LEVEL && arg[2] == '\0')
+            options->level = arg[1] - '0';
+        else if (strcmp(arg, "--zlib") == 0)
+            options->format = FORMAT_ZLIB;
+        else if (strcmp(arg, "--raw") == 0)
+            options->format = FORMAT_RAW;
+        else if (strcmp(arg, "--bgzf") == 0)
+            options->format = FORMAT_BGZF;
+        else if (strcmp(arg, "-D") == 0 && i + 1 < argc)
+            options->dictionary = argv[++i];
+        else if (strcmp(arg, "-v") == 0)
+            options->verbose = 1;
+        else if (strcmp(arg, "--rsyncable") == 0)
+            options->rsyncable = 1;
+        else if (strcmp(arg, "-r") == 0)
+            options->recursive = 1;
+        else if (strcmp(arg, "--manifest") == 0)
+            options->manifest = 1;
+        else if (strcmp(arg, "-d") == 0)
+            options->decompress = 1;
+        else if (strcmp(arg, "-p") == 0 && i + 1 < argc)
+            options->threads = parse_number(argv[++i], 1, MAX_THREADS, argv[0]);
+        else if (strcmp(arg, "-b") == 0 && i + 1 < argc)
+            options->chunk_size = parse_number(argv[++i], MIN_CHUNK_SIZE / 1024, MAX_CHUNK_SIZE / 1024, argv[0]) * 1024;
+        else if (arg[0] != '-')
+            options->paths[options->num_paths++] = arg;
+        else
+            usage(argv[0]);
+    }
 
-            storage[j + 1] = 16;
-            storage[j + 2] = length - 3;
+    // Chunks and files are cut at fixed sizes, so only the pipeline can follow the content
+    if (options->rsyncable && (options->threads > 0 || options->num_paths > 0 || options->manifest))
+        usage(argv[0]);
 
-            j += 3;
-            i += length + 1;
-        
-        } else {
-            storage[j] = current;
+    // BGZF members are independent gzip members, which can neither share a dictionary nor follow the content
+    if (options->format == FORMAT_BGZF && (options->dictionary != NULL || options->rsyncable || options->num_paths > 0 
+        || options->manifest))
+        usage(argv[0]);
 
-            j++;
-            i++;
-        }
-    }
+    // Decompression only reads the standard input, on one thread
+    if (options->decompress && (options->threads > 0 || options->rsyncable || options->num_paths > 0 
+        || options->manifest))
+        usage(argv[0]);
 
-    return j;
+    // The gzip format has no way to name a dictionary
+    if (options->dictionary != NULL && options->format == FORMAT_GZIP)
+        options->format = FORMAT_ZLIB;
 }
 
-/* Writes the code length data.
+/* Reads the whole file at path into a newly allocated buffer, storing its size in the value pointed to by size. Exits 
+ * with an error if the file cannot be read.
  */
-void write_cl_data(bitstream_t* stream, uint16_t ll_code_lengths[], uint16_t num_ll_codes, uint16_t dist_code_lengths[], uint16_t num_dist_codes) {
-    // Cutting off ending runs of zeros
-    num_ll_codes = count_codes(ll_code_lengths, num_ll_codes, 257);
-    num_dist_codes = count_codes(dist_code_lengths, num_dist_codes, 1);
-
-    unsigned int HLIT = num_ll_codes - 257;
-    unsigned int HDIST = num_dist_codes - 1;
-    
-    bitstream_push_bits(stream, HLIT,  5);
-    bitstream_push_bits(stream, HDIST, 5);
-
-    // Applying RLE using CL Symbols 16, 17, and 18
-    uint16_t new_ll_code_lengths[286] = {0};
-    uint16_t new_dist_code_lengths[30] = {0};
-    num_ll_codes = rle(num_ll_codes, ll_code_lengths, new_ll_code_lengths);
-    num_dist_codes = rle(num_dist_codes, dist_code_lengths, new_dist_code_lengths);
-
-    // Computing CL code
-    uint32_t frequencies[19] = {0};
-    get_cl_frequencies(frequencies, new_ll_code_lengths, num_ll_codes, new_dist_code_lengths, num_dist_codes);
-    
-    uint16_t cl_code[19];
-    uint16_t cl_code_lengths[19] = {0};
-    uint16_t cl_permutation[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
-    package_merge(7, 19, frequencies, cl_code_lengths);
-    construct_canonical_code(19, cl_code_lengths, cl_code);
-
-    // Cutting off ending runs of zeros
-    uint16_t num_cl_codes = count_cl_codes(cl_code_lengths, 19, cl_permutation, 4);
-    unsigned int HCLEN = num_cl_codes - 4; 
-    bitstream_push_bits(stream, HCLEN, 4);
-
-    // Pushing CL code
-    for (unsigned int i = 0; i < num_cl_codes; i++)
-        bitstream_push_bits(stream, cl_code_lengths[cl_permutation[i]], 3);
-    
-    uint16_t bits, code, len, offset;
-
-    // Pushing encoded ll code
-    // See rle to see how offsets are stored
-    for (unsigned int k = 0; k < num_ll_codes; k++) {
-        len = new_ll_code_lengths[k];
-        bits = cl_code_lengths[len];
-        code = cl_code[len];
-        bitstream_push_encoding(stream, code, bits);
-
-        if (len > 15) {
-            k++;
-            offset = new_ll_code_lengths[k];
-        }
-
-        if (len == 16) {
-            bitstream_push_bits(stream, offset, 2);
-        } else if (len == 17) {
-            bitstream_push_bits(stream, offset, 3);
-        } else if (len == 18) {
-            bitstream_push_bits(stream, offset, 7);
-        }
+uint8_t* read_file(char* path, uint32_t* size) {
+    FILE* file = fopen(path, "rb");
+    uint8_t* contents = NULL;
+    uint32_t capacity = 0, used = 0;
+    size_t result;
+
+    if (file == NULL) {
+        perror(path);
+        exit(1);
     }
 
-    // Pushing encoded distance code
-    if (num_dist_codes == 0) {
-        bitstream_push_bits(stream,0,5);
-
-    } else {
-        for (unsigned int k = 0; k < num_dist_codes; k++) {
-            len = new_dist_code_lengths[k];
-            bits = cl_code_lengths[len];
-            code = cl_code[len];
-            bitstream_push_encoding(stream, code, bits);
+    do {
+        if (used == capacity) {
+            capacity = (capacity == 0) ? PAST_SIZE : capacity * 2;
+            contents = realloc(contents, capacity);
 
-            if (len > 15) {
-                k++;
-                offset = new_dist_code_lengths[k];
-            }
-
-            if (len == 16) {
-                bitstream_push_bits(stream, offset, 2);
-            } else if (len == 17) {
-                bitstream_push_bits(stream, offset, 3);
-            } else if (len == 18) {
-                bitstream_push_bits(stream, offset, 7);
+            if (contents == NULL) {
+                fprintf(stderr, "gzoe: out of memory reading %s\n", path);
+                exit(1);
             }
         }
-    }
-}
 
-/* Pushes a block of type 2.
- */
-void block_2(bitstream_t* stream, uint16_t* contents, uint32_t block_size, uint32_t* ll_frequencies, uint32_t* dist_frequencies){
-    uint16_t ll_code_lengths[286] = {0}, ll_code[286];
-    uint16_t dist_code_lengths[30] = {0}, dist_code[30];
-
-    bitstream_push_bits(stream, 2, 2); 
-
-    package_merge(15, 286, ll_frequencies, ll_code_lengths);
-    package_merge(15, 30, dist_frequencies, dist_code_lengths);
-
-    construct_canonical_code(286, ll_code_lengths, ll_code);
-    construct_canonical_code(30, dist_code_lengths, dist_code);
-
-    write_cl_data(stream, ll_code_lengths, 286, dist_code_lengths, 30);
-
-    uint16_t bits;
-    uint16_t code;
-    uint32_t index = 0;
-    uint16_t current_symbol, offset;
-
-    while (index < block_size) {
-        current_symbol = contents[index];
-        index++;
-
-        bits = ll_code_lengths[current_symbol];
-        code = ll_code[current_symbol];
-        bitstream_push_encoding(stream, code, bits);
-
-        // See lzss in lzss.c to see how offsets and distance symbols are stored
-        if (current_symbol > 256) {
-            assert(index + 1 < MAX_BLOCK_SIZE);
-            offset = contents[index];
-            index++;
+        result = fread(contents + used, 1, capacity - used, file);
+        used += result;
+    } while (result > 0);
 
-            bitstream_push_bits(stream, offset >> 5, offset_bits(current_symbol));
-
-            current_symbol = offset & 31;
-            assert(current_symbol < 30);
-
-            bits = dist_code_lengths[current_symbol];
-            code = dist_code[current_symbol];
-            bitstream_push_encoding(stream, code, bits);
-
-            offset = contents[index];
-            index++;
-            
-            bitstream_push_bits(stream, offset, offset_bits(current_symbol));
-        }
+    if (ferror(file)) {
+        perror(path);
+        exit(1);
     }
 
-    bits = ll_code_lengths[256];
-    code = ll_code[256];
-    bitstream_push_encoding(stream, code, bits);
-
+    fclose(file);
+    *size = used;
+    return contents;
 }
 
-/* Pushes a block of type 1.
+/* Compresses the files named by the options on a pool of -p threads (one by default). Returns the exit status: 0 if 
+ * every file was found and compressed and 1 otherwise.
  */
-void block_1(bitstream_t* stream, uint16_t* contents, uint32_t block_size) {
-    uint16_t current_symbol, offset;
-    uint32_t bits, code, index = 0;
-
-    bitstream_push_bits(stream, 1, 2);
-
-    while (index < block_size) {
-        current_symbol = contents[index];
-        index++;
-
-        bits = ll_code_table[1][current_symbol];
-        code = ll_code_table[0][current_symbol];
-        bitstream_push_encoding(stream, code, bits); 
-
-        // See lzss in lzss.c to see how offsets and distance symbols are stored
-        if (current_symbol > 256) {
-            offset = contents[index];
-            index++;
-            bitstream_push_bits(stream, offset >> 5, offset_bits(current_symbol));
-
-            current_symbol = offset & 31;
-            assert(current_symbol < 32);
-
-            bits = dist_code_table[1][current_symbol];
-            code = dist_code_table[0][current_symbol];
-            bitstream_push_encoding(stream, code, bits);
-
-            assert(index < MAX_BLOCK_SIZE);
-            offset = contents[index];
-            index++;
-            
-            bitstream_push_bits(stream, offset, offset_bits(current_symbol));
-        }
-    } 
-    
-    bits = ll_code_table[1][256];
-    code = ll_code_table[0][256];
-    bitstream_push_encoding(stream, code, bits); 
-}
+int compress_files(options_t* options, uint8_t* dictionary, uint32_t dictionary_size, uint32_t dictionary_id) {
+    file_list_t list = {NULL, 0, 0};
+    batch_options_t batch = {options->level, options->format, dictionary, dictionary_size, dictionary_id, 
+        (options->threads > 0) ? options->threads : 1, options->chunk_size};
+    int result = 0;
 
-/* Pushes a block of type 0. Code by Bill Bird.
- */
-uint32_t block_0(bitstream_t* stream, uint8_t* contents, uint32_t block_size) {
-    bitstream_push_bits(stream, 0, 2);
-    bitstream_push_bits(stream, 0, 5); 
-    bitstream_push_u16(stream, block_size);
-    bitstream_push_u16(stream, ~block_size);
+    for (int i = 0; i < options->num_paths; i++)
+        result |= file_list_add(&list, options->paths[i], options->recursive);
 
-    for(unsigned int i = 0; i < block_size; i++)
-        bitstream_push_byte(stream, contents[i]); 
+    if (options->manifest)
+        result |= file_list_read(&list, stdin, options->recursive);
 
-    return 0;
-}
+    result |= compress_batch(&list, &batch);
 
-/* Preforms LZSS, then checks if the LZSS will make an improvement. If it won't, uses block type 0. If it will, then a 
- * freqeuncy count is performed. The results of the frequency count are then used to decide if using block type 2 will be
- * advantageous. 
- */
-uint32_t write_block(bitstream_t* stream, window_t* window, uint8_t* contents, uint32_t block_size) {
-    uint32_t bits_used;
-    uint16_t post_lzss_contents[MAX_BLOCK_SIZE];
-    uint32_t post_lzss_size = lzss(post_lzss_contents, window, contents, block_size, &bits_used);
-
-    if (bits_used > (block_size * 8) + 40) {
-        block_0(stream, contents, block_size);
-        return 0;
-    }
+    for (uint32_t i = 0; i < list.num_paths; i++)
+        free(list.paths[i]);
 
-    uint32_t ll_frequencies[288] = {0};
-    uint32_t dist_frequencies[32] = {0};
-    get_frequencies(ll_frequencies, dist_frequencies, post_lzss_contents, post_lzss_size);
+    free(list.paths);
+    free(dictionary);
+    return result;
+}
 
-    if (frequency_analysis(ll_frequencies, dist_frequencies) == 1) {
-        block_1(stream, post_lzss_contents, post_lzss_size);
-        return 0;
-    }
+/* Decompresses the standard input, which is in the format of the options, to the standard output. Returns 0, since
+ * invalid input exits with an error.
+ */
+int decompress(options_t* options, uint8_t* dictionary, uint32_t dictionary_size, uint32_t dictionary_id) {
+    inflate_options_t inflate = {options->format, dictionary, dictionary_size, dictionary_id};
 
-    block_2(stream, post_lzss_contents, post_lzss_size, ll_frequencies, dist_frequencies);
+    inflate_stream(STDIN_FILENO, stdout, &inflate);
+    free(dictionary);
     return 0;
 }
 
-/* Initializes the bitstream, default code tables, and sliding window. Collects a block of size MAX_BLOCK_SIZE
- * and then pushes that block. Based on code by Bill Bird.
+/* Parses the command line, then initializes the bitstream, default code tables, and sliding window, priming the 
+ * window with the dictionary if one was given. Compresses the input between the header and trailer of the chosen 
+ * format, as one stream through a pipeline of threads or in chunks on a pool of threads, unless files were named or 
+ * the input is to be decompressed. Based on code by Bill Bird.
  */
-int main() {
+int main(int argc, char** argv) {
+    options_t options;
+    parse_options(&options, argc, argv);
+
     bitstream_t stream;
     bitstream_init(&stream, stdout);
-
-    push_gzip_header(&stream);
     setup_default_code_tables();
 
-    uint8_t block_contents[MAX_BLOCK_SIZE];
-    
     window_t window;
     window_init(&window);
+    lzss_set_level(&window, options.level);
 
-    uint32_t block_size = 0;
-    uint32_t bytes_read = 0;
+    uint8_t* dictionary = NULL;
+    uint32_t dictionary_size = 0;
 
-    int next_byte;
-    uint32_t crc = 0;
+    if (options.dictionary != NULL) {
+        dictionary = read_file(options.dictionary, &dictionary_size);
+        lzss_set_dictionary(&window, dictionary, dictionary_size);
+    }
 
-    if ((next_byte = fgetc(stdin)) == EOF) {
-        
-    } else {
-        bytes_read++;
-        crc = crc_init((unsigned char) next_byte);
+    uint32_t dictionary_id = adler32(dictionary, dictionary_size, ADLER32_INIT);
 
-        while(1){
-            block_contents[block_size++] = (unsigned char) next_byte;
+    if (options.decompress || options.num_paths > 0 || options.manifest) {
+        int result = (options.decompress) ? decompress(&options, dictionary, dictionary_size, dictionary_id)
+            : compress_files(&options, dictionary, dictionary_size, dictionary_id);
 
-            if ((next_byte = fgetc(stdin)) == EOF)
-                break;
+        free(options.paths);
+        return result;
+    }
 
-            bytes_read++;
-            crc = crc_continue((unsigned char) next_byte, crc);
+    push_header(&stream, options.format, options.level, dictionary_size, dictionary_id);
 
-            if (block_size == MAX_BLOCK_SIZE){
-                bitstream_push_bit(&stream, 0);
-                block_size = write_block(&stream, &window, block_contents, block_size);
-            }
-        }
-    }
+    input_stream_t input;
+    input_stream_init(&input, STDIN_FILENO);
+    input.checksum = (options.format == FORMAT_GZIP) ? CHECKSUM_CRC32 
+        : (options.format == FORMAT_ZLIB) ? CHECKSUM_ADLER32 : CHECKSUM_NONE;
 
-    if (block_size > 0) {
-        bitstream_push_bit(&stream, 1); 
-        block_size = write_block(&stream, &window, block_contents, block_size);
-    }
+    pipeline_options_t pipeline = {options.level, options.rsyncable, options.verbose};
+
+    if (options.format == FORMAT_BGZF)
+        bgzf_parallel(&stream, &input, options.level, (options.threads > 0) ? options.threads : 1);
+    else if (options.threads > 0)
+        deflate_parallel(&stream, &input, options.level, dictionary, dictionary_size, options.threads, 
+            options.chunk_size);
+    else
+        deflate_pipelined(&stream, &window, &input, &pipeline);
 
-    bitstream_flush_to_byte(&stream);
-    bitstream_push_u32(&stream, crc);
-    bitstream_push_u32(&stream, bytes_read);
+    push_trailer(&stream, options.format, input.crc, input.adler, input.bytes_read);
     bitstream_finalize(&stream);
+    free(options.paths);
+    free(dictionary);
 
     return 0;
 }
@@ -0,0 +1,834 @@
+/* inflate.c
+
+   Definitions of the functions declared in inflate.h
+
+   Zoe Johnston - 2023/06/25
+*/
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "stdint.h"
+#include "string.h"
+#include "errno.h"
+#include "unistd.h"
+#include "inflate.h"
+#include "deflate.h"
+#include "CRC_for_C.h"
+#include "adler32.h"
+
+#define HISTORY_SIZE 32768
+#define OUTPUT_SIZE (1 << 20)
+#define INPUT_SIZE (1 << 20)
+
+// Room past the end of the output for the last symbol before a flush, and for the word a match copy overshoots by
+#define OUTPUT_SLACK 512
+
+#define MAX_CODE_LENGTH 15
+#define NUM_LITLEN_SYMBOLS 288
+#define NUM_DIST_SYMBOLS 32
+#define NUM_CODELEN_SYMBOLS 19
+
+// Bits of the code looked up by the first level of each table, and the size of each table with its subtables. A
+// subtable is only needed for a code longer than the first level, and holds at most 2^(15 - bits) entries.
+#define LITLEN_BITS 11
+#define DIST_BITS 8
+#define CODELEN_BITS 7
+#define LITLEN_TABLE_SIZE ((1 << LITLEN_BITS) + NUM_LITLEN_SYMBOLS * (1 << (MAX_CODE_LENGTH - LITLEN_BITS)))
+#define DIST_TABLE_SIZE ((1 << DIST_BITS) + NUM_DIST_SYMBOLS * (1 << (MAX_CODE_LENGTH - DIST_BITS)))
+#define CODELEN_TABLE_SIZE (1 << CODELEN_BITS)
+
+/* Every table entry is 32 bits:
+ *   bits 0-7    the number of bits of input it consumes (for a subtable, the bits of the first level)
+ *   bits 8-11   its kind
+ *   bits 12-15  the number of extra bits after the code, or for a subtable the number of bits indexing it
+ *   bits 16-31  its literal (or two, the first in the low byte), base length or distance, symbol or subtable offset
+ */
+#define ENTRY(kind, value, extra, bits) (((uint32_t) (value) << 16) | ((extra) << 12) | ((kind) << 8) | (bits))
+#define ENTRY_BITS(entry) ((entry) & 0xFF)
+#define ENTRY_KIND(entry) (((entry) >> 8) & 0xF)
+#define ENTRY_EXTRA(entry) (((entry) >> 12) & 0xF)
+#define ENTRY_VALUE(entry) ((entry) >> 16)
+
+#define KIND_INVALID 0
+#define KIND_LITERAL 1
+#define KIND_PAIR 2
+#define KIND_LENGTH 3
+#define KIND_END 4
+#define KIND_DISTANCE 5
+#define KIND_SYMBOL 6
+#define KIND_SUBTABLE 7
+
+#define BITS_MASK(bits) ((1u << (bits)) - 1)
+
+#define GZIP_FHCRC 0x02
+#define GZIP_FEXTRA 0x04
+#define GZIP_FNAME 0x08
+#define GZIP_FCOMMENT 0x10
+#define GZIP_RESERVED 0xE0
+
+/* Reads the input a little-endian word at a time into bits, of which the low count are yet to be consumed. The input is
+ * read from fd into buffer a piece at a time, and next up to end are the bytes read but not yet loaded. Once it runs
+ * out, which sets eof, zeros are read instead and counted by overrun.
+ */
+typedef struct {
+    const uint8_t* next;
+    const uint8_t* end;
+    uint64_t bits;
+    unsigned int count, overrun;
+    uint8_t* buffer;
+    int fd, eof;
+} bit_reader_t;
+
+/* The state of the decompressor. Output is decoded into buffer after HISTORY_SIZE bytes of history, and written out
+ * (from flushed) when it fills. start is the earliest byte a match may copy from, which is the start of the member
+ * or its dictionary until a flush. format is FORMAT_GZIP for BGZF.
+ */
+typedef struct {
+    bit_reader_t in;
+    uint8_t* buffer;
+    uint8_t* out;
+    uint8_t* flushed;
+    uint8_t* start;
+    FILE* output;
+    int format;
+    uint32_t crc, adler;
+    uint64_t size;
+    uint32_t litlen[LITLEN_TABLE_SIZE];
+    uint32_t dist[DIST_TABLE_SIZE];
+    uint32_t codelen[CODELEN_TABLE_SIZE];
+} inflater_t;
+
+static const uint16_t length_bases[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67,
+    83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5,
+    5, 5, 0};
+static const uint16_t distance_bases[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513,
+    769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t distance_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+    11, 11, 12, 12, 13, 13};
+
+// The order in which the lengths of the code length code are stored
+static const uint8_t codelen_order[NUM_CODELEN_SYMBOLS] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14,
+    1, 15};
+
+// The entry (without its bit count) of every symbol of each code
+static uint32_t litlen_entries[NUM_LITLEN_SYMBOLS];
+static uint32_t dist_entries[NUM_DIST_SYMBOLS];
+static uint32_t codelen_entries[NUM_CODELEN_SYMBOLS];
+
+static uint32_t fixed_litlen[LITLEN_TABLE_SIZE];
+static uint32_t fixed_dist[DIST_TABLE_SIZE];
+
+/* Prints why the input could not be decompressed and exits with an error.
+ */
+static void inflate_error(const char* reason) {
+    fprintf(stderr, "gzoe: invalid compressed data -- %s\n", reason);
+    exit(1);
+}
+
+static inline uint64_t load_le64(const uint8_t* data) {
+    uint64_t word;
+    memcpy(&word, data, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+static inline void copy_word(uint8_t* destination, const uint8_t* source) {
+    uint64_t word;
+    memcpy(&word, source, 8);
+    memcpy(destination, &word, 8);
+}
+
+/* Reads more input until at least size bytes (up to INPUT_SIZE - 8) are available at next, or the input ends, and
+ * returns how many are. The bytes not yet loaded are first moved to the start of the buffer, along with the 8 before
+ * them, which may still be buffered as bits that reader_align gives back.
+ */
+static size_t reader_fill(bit_reader_t* in, size_t size) {
+    size_t keep = (in->next - in->buffer < 8) ? (size_t) (in->next - in->buffer) : 8;
+    size_t available = in->end - in->next;
+    ssize_t result;
+
+    if (available >= size || in->eof)
+        return available;
+
+    memmove(in->buffer, in->next - keep, keep + available);
+    in->next = in->buffer + keep;
+
+    while (available < size && !in->eof) {
+        result = read(in->fd, in->buffer + keep + available, INPUT_SIZE - keep - available);
+
+        if (result < 0 && errno == EINTR)
+            continue;
+
+        if (result < 0) {
+            perror("gzoe: read");
+            exit(1);
+        }
+
+        in->eof = (result == 0);
+        available += result;
+    }
+
+    in->end = in->next + available;
+    return available;
+}
+
+/* Returns the next size bytes after a byte boundary and moves past them, exiting with an error if the input ends
+ * first.
+ */
+static const uint8_t* reader_bytes(bit_reader_t* in, size_t size) {
+    const uint8_t* data;
+
+    if (reader_fill(in, size) < size)
+        inflate_error("unexpected end of data");
+
+    data = in->next;
+    in->next += size;
+    return data;
+}
+
+/* Reads more input, then bytes one at a time until at least 56 bits are buffered, past the end of the input if
+ * necessary. A reader that has read well past the end can only be decoding garbage, so it stops there.
+ */
+static void refill_slowly(bit_reader_t* in) {
+    uint64_t byte;
+
+    reader_fill(in, 8);
+
+    while (in->count < 56) {
+        if (in->next < in->end) {
+            byte = *in->next++;
+        } else {
+            byte = 0;
+
+            if (++in->overrun > 16)
+                inflate_error("unexpected end of data");
+        }
+
+        in->bits |= byte << in->count;
+        in->count += 8;
+    }
+}
+
+/* Tops the buffer up to at least 56 bits. Away from the end of the input this is a single load: the word is shifted
+ * in above the bits already buffered and the whole bytes that fit are skipped. The partial byte at the top is loaded
+ * again next time, which leaves the same bits in place.
+ */
+static inline void refill(bit_reader_t* in) {
+    if (in->end - in->next >= 8) {
+        in->bits |= load_le64(in->next) << in->count;
+        in->next += 7 - (in->count >> 3);
+        in->count |= 56;
+    } else {
+        refill_slowly(in);
+    }
+}
+
+static inline void consume(bit_reader_t* in, unsigned int bits) {
+    in->bits >>= bits;
+    in->count -= bits;
+}
+
+/* Starts reading bits from fd, through buffer of INPUT_SIZE bytes.
+ */
+static void reader_init(bit_reader_t* in, int fd, uint8_t* buffer) {
+    in->next = buffer;
+    in->end = buffer;
+    in->bits = 0;
+    in->count = 0;
+    in->overrun = 0;
+    in->buffer = buffer;
+    in->fd = fd;
+    in->eof = 0;
+}
+
+/* Skips to the next byte boundary and gives back the whole bytes buffered as bits, so that next is the first byte not
+ * yet consumed. Exits with an error if that is past the end of the input.
+ */
+static void reader_align(bit_reader_t* in) {
+    consume(in, in->count & 7);
+
+    if (in->overrun > in->count / 8)
+        inflate_error("unexpected end of data");
+
+    in->next -= in->count / 8 - in->overrun;
+    in->bits = 0;
+    in->count = 0;
+    in->overrun = 0;
+}
+
+static uint16_t reverse_bits(uint16_t code, unsigned int length) {
+    uint16_t reversed = 0;
+
+    for (unsigned int i = 0; i < length; i++) {
+        reversed = (reversed << 1) | (code & 1);
+        code >>= 1;
+    }
+
+    return reversed;
+}
+
+/* Fills table, which has 2^root_bits entries followed by room for subtables, to decode the canonical code with the
+ * given lengths for num_symbols symbols whose entries are in entries. Codes are read starting from their first bit,
+ * which is the low bit of the input, so each is reversed and repeated through every entry ending in it. Longer codes
+ * share a subtable with the codes whose first root_bits bits are the same. Returns 0, or 1 if the lengths are not a
+ * valid code. An incomplete code is only accepted when it is empty or, if allow_single is set, has a single symbol of
+ * length 1. RFC 1951 allows that for distances, and zlib for literal/length codes but never for the code length code.
+ * The entries an incomplete code leaves unused are invalid.
+ */
+static int build_table(uint32_t* table, unsigned int root_bits, const uint8_t* lengths, unsigned int num_symbols,
+    const uint32_t* entries, int allow_single) {
+    uint16_t count[MAX_CODE_LENGTH + 1] = {0};
+    uint16_t next_code[MAX_CODE_LENGTH + 1];
+    uint16_t codes[NUM_LITLEN_SYMBOLS];
+    uint8_t subtable_bits[1 << LITLEN_BITS] = {0};
+    uint32_t root_size = 1u << root_bits, used = root_size, prefix, entry, length;
+    int left = 1, num_codes = 0;
+
+    for (unsigned int symbol = 0; symbol < num_symbols; symbol++)
+        count[lengths[symbol]]++;
+
+    next_code[0] = 0;
+    count[0] = 0;
+
+    for (length = 1; length <= MAX_CODE_LENGTH; length++) {
+        left = 2 * left - count[length];
+        num_codes += count[length];
+        next_code[length] = (next_code[length - 1] + count[length - 1]) << 1;
+
+        if (left < 0)
+            return 1;
+    }
+
+    if (left > 0 && num_codes > 0 && !(allow_single && num_codes == 1 && count[1] == 1))
+        return 1;
+
+    for (uint32_t i = 0; i < root_size; i++)
+        table[i] = ENTRY(KIND_INVALID, 0, 0, 0);
+
+    for (unsigned int symbol = 0; symbol < num_symbols; symbol++) {
+        length = lengths[symbol];
+
+        if (length == 0)
+            continue;
+
+        codes[symbol] = reverse_bits(next_code[length]++, length);
+
+        if (length > root_bits) {
+            prefix = codes[symbol] & BITS_MASK(root_bits);
+
+            if (length - root_bits > subtable_bits[prefix])
+                subtable_bits[prefix] = length - root_bits;
+        }
+    }
+
+    for (prefix = 0; prefix < root_size; prefix++) {
+        if (subtable_bits[prefix] == 0)
+            continue;
+
+        table[prefix] = ENTRY(KIND_SUBTABLE, used, subtable_bits[prefix], root_bits);
+
+        for (uint32_t i = 0; i < (1u << subtable_bits[prefix]); i++)
+            table[used + i] = ENTRY(KIND_INVALID, 0, 0, 0);
+
+        used += 1u << subtable_bits[prefix];
+    }
+
+    for (unsigned int symbol = 0; symbol < num_symbols; symbol++) {
+        length = lengths[symbol];
+
+        if (length == 0) {
+            continue;
+        } else if (length <= root_bits) {
+            for (uint32_t i = codes[symbol]; i < root_size; i += 1u << length)
+                table[i] = entries[symbol] | length;
+        } else {
+            entry = table[codes[symbol] & BITS_MASK(root_bits)];
+
+            for (uint32_t i = codes[symbol] >> root_bits; i < (1u << ENTRY_EXTRA(entry));
+                i += 1u << (length - root_bits))
+                table[ENTRY_VALUE(entry) + i] = entries[symbol] | (length - root_bits);
+        }
+    }
+
+    return 0;
+}
+
+/* Replaces every first level entry of a literal/length table that decodes a literal, where the bits after it in the
+ * index decode another, with an entry for both. The bits after a code of length n are the index shifted down by n,
+ * whose entry is only right if its code fits in the bits that were actually there. Working down from the top means
+ * that entry (at a lower index) has not been replaced yet.
+ */
+static void pair_literals(uint32_t* table) {
+    uint32_t first, second;
+
+    for (int i = (1 << LITLEN_BITS) - 1; i >= 0; i--) {
+        first = table[i];
+
+        if (ENTRY_KIND(first) != KIND_LITERAL)
+            continue;
+
+        second = table[i >> ENTRY_BITS(first)];
+
+        if (ENTRY_KIND(second) == KIND_LITERAL && ENTRY_BITS(first) + ENTRY_BITS(second) <= LITLEN_BITS)
+            table[i] = ENTRY(KIND_PAIR, ENTRY_VALUE(first) | (ENTRY_VALUE(second) << 8), 0,
+                ENTRY_BITS(first) + ENTRY_BITS(second));
+    }
+}
+
+/* Fills in the entries of every symbol and builds the tables of the fixed codes, once.
+ */
+static void setup_tables(void) {
+    static int done = 0;
+    uint8_t lengths[NUM_LITLEN_SYMBOLS];
+
+    if (done)
+        return;
+
+    for (int symbol = 0; symbol < NUM_LITLEN_SYMBOLS; symbol++) {
+        if (symbol < 256)
+            litlen_entries[symbol] = ENTRY(KIND_LITERAL, symbol, 0, 0);
+        else if (symbol == 256)
+            litlen_entries[symbol] = ENTRY(KIND_END, 0, 0, 0);
+        else if (symbol < 286)
+            litlen_entries[symbol] = ENTRY(KIND_LENGTH, length_bases[symbol - 257], length_extra[symbol - 257], 0);
+        else
+            litlen_entries[symbol] = ENTRY(KIND_INVALID, 0, 0, 0);
+    }
+
+    for (int symbol = 0; symbol < NUM_DIST_SYMBOLS; symbol++)
+        dist_entries[symbol] = (symbol < 30) ? ENTRY(KIND_DISTANCE, distance_bases[symbol], distance_extra[symbol], 0)
+            : ENTRY(KIND_INVALID, 0, 0, 0);
+
+    for (int symbol = 0; symbol < NUM_CODELEN_SYMBOLS; symbol++)
+        codelen_entries[symbol] = ENTRY(KIND_SYMBOL, symbol, 0, 0);
+
+    // The fixed code of RFC 1951 section 3.2.6, including the two distance codes that are never used
+    for (int symbol = 0; symbol < NUM_LITLEN_SYMBOLS; symbol++)
+        lengths[symbol] = (symbol < 144) ? 8 : (symbol < 256) ? 9 : (symbol < 280) ? 7 : 8;
+
+    build_table(fixed_litlen, LITLEN_BITS, lengths, NUM_LITLEN_SYMBOLS, litlen_entries, 1);
+    pair_literals(fixed_litlen);
+
+    memset(lengths, 5, NUM_DIST_SYMBOLS);
+    build_table(fixed_dist, DIST_BITS, lengths, NUM_DIST_SYMBOLS, dist_entries, 1);
+
+    done = 1;
+}
+
+/* Writes the output decoded since the last flush and adds it to the checksum, then moves the last HISTORY_SIZE bytes
+ * to the start of the buffer for later matches to copy from.
+ */
+static void flush_output(inflater_t* state) {
+    size_t size = state->out - state->flushed, shift;
+
+    if (size > 0 && fwrite(state->flushed, 1, size, state->output) != size) {
+        perror("gzoe");
+        exit(1);
+    }
+
+    if (state->format == FORMAT_GZIP)
+        state->crc = crc_buffer(state->flushed, size, state->crc);
+    else if (state->format == FORMAT_ZLIB)
+        state->adler = adler32(state->flushed, size, state->adler);
+
+    state->size += size;
+    shift = state->out - (state->buffer + HISTORY_SIZE);
+
+    if (shift > 0) {
+        memmove(state->buffer, state->buffer + shift, HISTORY_SIZE);
+        state->out -= shift;
+        state->start = ((size_t) (state->start - state->buffer) > shift) ? state->start - shift : state->buffer;
+    }
+
+    state->flushed = state->out;
+}
+
+/* Copies length bytes from distance bytes back to out. Matches at least a word back are copied a word at a time,
+ * which may write up to 7 bytes past the end. Closer matches overlap the bytes they write, so they are copied a byte
+ * at a time, except for runs of one byte.
+ */
+static inline void copy_match(uint8_t* out, unsigned int distance, unsigned int length) {
+    const uint8_t* source = out - distance;
+    uint8_t* end = out + length;
+
+    if (distance >= 8) {
+        do {
+            copy_word(out, source);
+            out += 8;
+            source += 8;
+        } while (out < end);
+    } else if (distance == 1) {
+        memset(out, *source, length);
+    } else {
+        do {
+            *out++ = *source++;
+        } while (out < end);
+    }
+}
+
+/* Decodes a block compressed with the given tables, up to and including its end of block code. After a refill there
+ * are at least 56 bits buffered, which is enough for a length and distance with their extra bits (at most 48).
+ */
+static void inflate_huffman(inflater_t* state, const uint32_t* litlen, const uint32_t* dist) {
+    bit_reader_t in = state->in;
+    uint8_t* out = state->out;
+    uint8_t* start = state->start;
+    uint8_t* limit = state->buffer + HISTORY_SIZE + OUTPUT_SIZE;
+    uint32_t entry, length, distance;
+
+    for (;;) {
+        if (out >= limit) {
+            state->out = out;
+            flush_output(state);
+            out = state->out;
+            start = state->start;
+        }
+
+        refill(&in);
+        entry = litlen[in.bits & BITS_MASK(LITLEN_BITS)];
+
+        if (ENTRY_KIND(entry) == KIND_SUBTABLE) {
+            consume(&in, LITLEN_BITS);
+            entry = litlen[ENTRY_VALUE(entry) + (in.bits & BITS_MASK(ENTRY_EXTRA(entry)))];
+        }
+
+        consume(&in, ENTRY_BITS(entry));
+
+        if (ENTRY_KIND(entry) == KIND_LITERAL) {
+            *out++ = ENTRY_VALUE(entry);
+        } else if (ENTRY_KIND(entry) == KIND_PAIR) {
+            out[0] = ENTRY_VALUE(entry);
+            out[1] = ENTRY_VALUE(entry) >> 8;
+            out += 2;
+        } else if (ENTRY_KIND(entry) == KIND_LENGTH) {
+            length = ENTRY_VALUE(entry) + (in.bits & BITS_MASK(ENTRY_EXTRA(entry)));
+            consume(&in, ENTRY_EXTRA(entry));
+
+            entry = dist[in.bits & BITS_MASK(DIST_BITS)];
+
+            if (ENTRY_KIND(entry) == KIND_SUBTABLE) {
+                consume(&in, DIST_BITS);
+                entry = dist[ENTRY_VALUE(entry) + (in.bits & BITS_MASK(ENTRY_EXTRA(entry)))];
+            }
+
+            if (ENTRY_KIND(entry) != KIND_DISTANCE)
+                inflate_error("invalid distance code");
+
+            consume(&in, ENTRY_BITS(entry));
+            distance = ENTRY_VALUE(entry) + (in.bits & BITS_MASK(ENTRY_EXTRA(entry)));
+            consume(&in, ENTRY_EXTRA(entry));
+
+            if (distance > (size_t) (out - start))
+                inflate_error("invalid distance too far back");
+
+            copy_match(out, distance, length);
+            out += length;
+        } else if (ENTRY_KIND(entry) == KIND_END) {
+            break;
+        } else {
+            inflate_error("invalid literal/length code");
+        }
+    }
+
+    state->in = in;
+    state->out = out;
+}
+
+/* Copies a stored block, whose header starts at the next byte boundary, to the output as its input is read.
+ */
+static void inflate_stored(inflater_t* state) {
+    bit_reader_t* in = &state->in;
+    uint8_t* limit = state->buffer + HISTORY_SIZE + OUTPUT_SIZE;
+    const uint8_t* header;
+    uint32_t length, size;
+
+    reader_align(in);
+    header = reader_bytes(in, 4);
+    length = header[0] | (header[1] << 8);
+
+    if ((header[2] | (header[3] << 8)) != (~length & 0xFFFF))
+        inflate_error("invalid stored block lengths");
+
+    while (length > 0) {
+        if (state->out >= limit)
+            flush_output(state);
+
+        if (reader_fill(in, 1) == 0)
+            inflate_error("unexpected end of data");
+
+        size = (length < (uint32_t) (limit - state->out)) ? length : (uint32_t) (limit - state->out);
+        size = (size < (uint32_t) (in->end - in->next)) ? size : (uint32_t) (in->end - in->next);
+        memcpy(state->out, in->next, size);
+        state->out += size;
+        in->next += size;
+        length -= size;
+    }
+}
+
+/* Reads the code lengths at the start of a dynamic block and builds its tables.
+ */
+static void read_dynamic_tables(inflater_t* state) {
+    bit_reader_t* in = &state->in;
+    uint8_t lengths[NUM_LITLEN_SYMBOLS + NUM_DIST_SYMBOLS];
+    uint8_t codelen_lengths[NUM_CODELEN_SYMBOLS] = {0};
+    uint32_t num_litlen, num_dist, num_codelen, n = 0, entry, symbol, repeat;
+    uint8_t previous;
+
+    refill(in);
+    num_litlen = (in->bits & 31) + 257;
+    num_dist = ((in->bits >> 5) & 31) + 1;
+    num_codelen = ((in->bits >> 10) & 15) + 4;
+    consume(in, 14);
+
+    if (num_litlen > 286 || num_dist > 30)
+        inflate_error("too many length or distance symbols");
+
+    for (uint32_t i = 0; i < num_codelen; i++) {
+        refill(in);
+        codelen_lengths[codelen_order[i]] = in->bits & 7;
+        consume(in, 3);
+    }
+
+    if (build_table(state->codelen, CODELEN_BITS, codelen_lengths, NUM_CODELEN_SYMBOLS, codelen_entries, 0))
+        inflate_error("invalid code lengths set");
+
+    while (n < num_litlen + num_dist) {
+        refill(in);
+        entry = state->codelen[in->bits & BITS_MASK(CODELEN_BITS)];
+
+        if (ENTRY_KIND(entry) != KIND_SYMBOL)
+            inflate_error("invalid code lengths set");
+
+        consume(in, ENTRY_BITS(entry));
+        symbol = ENTRY_VALUE(entry);
+
+        if (symbol < 16) {
+            lengths[n++] = symbol;
+            continue;
+        }
+
+        if (symbol == 16) {
+            if (n == 0)
+                inflate_error("invalid bit length repeat");
+
+            previous = lengths[n - 1];
+            repeat = 3 + (in->bits & 3);
+            consume(in, 2);
+        } else if (symbol == 17) {
+            previous = 0;
+            repeat = 3 + (in->bits & 7);
+            consume(in, 3);
+        } else {
+            previous = 0;
+            repeat = 11 + (in->bits & 127);
+            consume(in, 7);
+        }
+
+        if (n + repeat > num_litlen + num_dist)
+            inflate_error("invalid bit length repeat");
+
+        memset(lengths + n, previous, repeat);
+        n += repeat;
+    }
+
+    if (lengths[256] == 0)
+        inflate_error("missing end-of-block code");
+
+    if (build_table(state->litlen, LITLEN_BITS, lengths, num_litlen, litlen_entries, 1))
+        inflate_error("invalid literal/lengths set");
+
+    if (build_table(state->dist, DIST_BITS, lengths + num_litlen, num_dist, dist_entries, 1))
+        inflate_error("invalid distances set");
+
+    pair_literals(state->litlen);
+}
+
+/* Decodes blocks until the last one.
+ */
+static void inflate_blocks(inflater_t* state) {
+    uint32_t last, type;
+
+    do {
+        refill(&state->in);
+        last = state->in.bits & 1;
+        type = (state->in.bits >> 1) & 3;
+        consume(&state->in, 3);
+
+        if (type == 0) {
+            inflate_stored(state);
+        } else if (type == 1) {
+            inflate_huffman(state, fixed_litlen, fixed_dist);
+        } else if (type == 2) {
+            read_dynamic_tables(state);
+            inflate_huffman(state, state->litlen, state->dist);
+        } else {
+            inflate_error("invalid block type");
+        }
+    } while (!last);
+}
+
+/* Reads the header of a gzip member, checking its CRC if it has one, up to where its DEFLATE data starts.
+ */
+static void read_gzip_header(bit_reader_t* in) {
+    const uint8_t* data;
+    const uint8_t* terminator;
+    uint32_t flags, size, crc;
+
+    if (reader_fill(in, 10) < 10 || in->next[0] != 0x1f || in->next[1] != 0x8b)
+        inflate_error("not in gzip format");
+
+    data = reader_bytes(in, 10);
+
+    if (data[2] != 8)
+        inflate_error("unknown compression method");
+
+    flags = data[3];
+    crc = crc_buffer(data, 10, 0);
+
+    if (flags & GZIP_RESERVED)
+        inflate_error("reserved flags set");
+
+    if (flags & GZIP_FEXTRA) {
+        data = reader_bytes(in, 2);
+        size = data[0] | (data[1] << 8);
+        crc = crc_buffer(data, 2, crc);
+        crc = crc_buffer(reader_bytes(in, size), size, crc);
+    }
+
+    // The name and comment end with a zero byte, and may not all have been read yet
+    for (uint32_t flag = GZIP_FNAME; flag <= GZIP_FCOMMENT; flag <<= 1) {
+        if (!(flags & flag))
+            continue;
+
+        do {
+            if (reader_fill(in, 1) == 0)
+                inflate_error("unexpected end of data");
+
+            terminator = memchr(in->next, 0, in->end - in->next);
+            size = (terminator != NULL) ? (uint32_t) (terminator + 1 - in->next) : (uint32_t) (in->end - in->next);
+            crc = crc_buffer(reader_bytes(in, size), size, crc);
+        } while (terminator == NULL);
+    }
+
+    if (flags & GZIP_FHCRC) {
+        data = reader_bytes(in, 2);
+
+        if ((crc & 0xFFFF) != (uint32_t) (data[0] | (data[1] << 8)))
+            inflate_error("header CRC mismatch");
+    }
+}
+
+/* Reads the header of a zlib stream. Returns 1 if the stream needs a dictionary, checking that it names the given one,
+ * and 0 otherwise.
+ */
+static int read_zlib_header(bit_reader_t* in, inflate_options_t* options) {
+    const uint8_t* data;
+    uint32_t id;
+
+    if (reader_fill(in, 2) < 2)
+        inflate_error("incorrect zlib header");
+
+    data = reader_bytes(in, 2);
+
+    if ((data[0] & 0xF) != 8 || (data[0] >> 4) > 7 || ((data[0] << 8) | data[1]) % 31 != 0)
+        inflate_error("incorrect zlib header");
+
+    if (!(data[1] & 0x20))
+        return 0;
+
+    data = reader_bytes(in, 4);
+    id = ((uint32_t) data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+
+    if (options->dictionary_size == 0)
+        inflate_error("stream needs a dictionary (-D)");
+
+    if (id != options->dictionary_id)
+        inflate_error("dictionary does not match");
+
+    return 1;
+}
+
+static uint32_t load_le32(const uint8_t* data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+/* Puts the end of the dictionary (or all of it, if it is shorter than the history) before the output, for matches to
+ * copy from.
+ */
+static void prime_history(inflater_t* state, const uint8_t* dictionary, uint32_t dictionary_size) {
+    uint32_t size = (dictionary_size < HISTORY_SIZE) ? dictionary_size : HISTORY_SIZE;
+
+    memcpy(state->out - size, dictionary + dictionary_size - size, size);
+    state->start = state->out - size;
+}
+
+/* Decompresses everything read from input to output. Every gzip member starts with an empty history and its own CRC 
+ * and size, and only a gzip header may follow one. Anything else left over is ignored with a warning, as gzip does.
+ */
+void inflate_stream(int input, FILE* output, inflate_options_t* options) {
+    inflater_t* state = malloc(sizeof(inflater_t));
+    uint8_t* buffer = malloc(INPUT_SIZE);
+    const uint8_t* trailer;
+
+    if (state == NULL || buffer == NULL
+        || (state->buffer = malloc(HISTORY_SIZE + OUTPUT_SIZE + OUTPUT_SLACK)) == NULL) {
+        fprintf(stderr, "gzoe: out of memory\n");
+        exit(1);
+    }
+
+    setup_tables();
+    reader_init(&state->in, input, buffer);
+    state->output = output;
+    state->format = (options->format == FORMAT_BGZF) ? FORMAT_GZIP : options->format;
+
+    do {
+        state->out = state->flushed = state->start = state->buffer + HISTORY_SIZE;
+        state->crc = 0;
+        state->adler = ADLER32_INIT;
+        state->size = 0;
+
+        if (state->format == FORMAT_GZIP) {
+            read_gzip_header(&state->in);
+        } else if (state->format == FORMAT_ZLIB) {
+            if (read_zlib_header(&state->in, options))
+                prime_history(state, options->dictionary, options->dictionary_size);
+        } else if (options->dictionary_size > 0) {
+            prime_history(state, options->dictionary, options->dictionary_size);
+        }
+
+        inflate_blocks(state);
+        flush_output(state);
+        reader_align(&state->in);
+
+        if (state->format == FORMAT_GZIP) {
+            trailer = reader_bytes(&state->in, 8);
+
+            if (load_le32(trailer) != state->crc)
+                inflate_error("CRC mismatch");
+
+            if (load_le32(trailer + 4) != (uint32_t) state->size)
+                inflate_error("length mismatch");
+        } else if (state->format == FORMAT_ZLIB) {
+            trailer = reader_bytes(&state->in, 4);
+
+            if ((((uint32_t) trailer[0] << 24) | (trailer[1] << 16) | (trailer[2] << 8) | trailer[3]) != state->adler)
+                inflate_error("Adler-32 mismatch");
+        }
+    } while (state->format == FORMAT_GZIP && reader_fill(&state->in, 2) >= 2 && state->in.next[0] == 0x1f
+        && state->in.next[1] == 0x8b);
+
+    if (reader_fill(&state->in, 1) > 0)
+        fprintf(stderr, "gzoe: trailing garbage ignored\n");
+
+    if (fflush(output) != 0) {
+        perror("gzoe");
+        exit(1);
+    }
+
+    free(state->buffer);
+    free(state);
+    free(buffer);
+}
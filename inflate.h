@@ -0,0 +1,31 @@
+/* inflate.h
+
+   Decompression of gzip, zlib and raw DEFLATE streams with table-driven Huffman decoding.
+
+   Zoe Johnston - 2023/06/25
+*/
+
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include "stdio.h"
+#include "stdint.h"
+
+/* What inflate_stream expects its input to be. format is one of the FORMAT_ constants in deflate.h, where BGZF is read
+ * as gzip. The dictionary (if dictionary_size is not 0) primes the history of a zlib stream whose header names
+ * dictionary_id, or of a raw stream.
+ */
+typedef struct {
+    int format;
+    const uint8_t* dictionary;
+    uint32_t dictionary_size, dictionary_id;
+} inflate_options_t;
+
+/* Decompresses everything read from the file descriptor input to output, a piece at a time, so memory does not grow
+ * with the input and output is written while the input is still arriving. A gzip input may be any number of members
+ * one after the other, as in BGZF, and each member's CRC and size is checked, as is the Adler-32 of a zlib stream.
+ * Prints the problem and exits with an error if the data is not valid or cannot be read.
+ */
+void inflate_stream(int input, FILE* output, inflate_options_t* options);
+
+#endif
@@ -0,0 +1,57 @@
+/* input_stream.c
+
+   Definitions of the functions declared in input_stream.h
+
+   Zoe Johnston - 2023/06/25
+*/ 
+
+#include "stdio.h"
+#include "stdint.h"
+#include "errno.h"
+#include "stdlib.h"
+#include "unistd.h"
+#include "input_stream.h"
+#include "CRC_for_C.h"
+#include "adler32.h"
+
+/* Initialize an input_stream_t structure. MUST be called before any of the below functions are used. */
+void input_stream_init(input_stream_t* stream, int input_fd) {
+    stream->input_fd = input_fd;
+    stream->crc = 0;
+    stream->adler = ADLER32_INIT;
+    stream->bytes_read = 0;
+    stream->checksum = CHECKSUM_CRC32;
+}
+
+/* Read up to size bytes into buffer, returning the number of bytes read. Fewer than size bytes are 
+   only returned once the end of the input has been reached. */
+uint32_t input_stream_read(input_stream_t* stream, uint8_t* buffer, uint32_t size) {
+    uint32_t total = 0;
+    ssize_t result;
+
+    while (total < size) {
+        result = read(stream->input_fd, buffer + total, size - total);
+
+        if (result < 0 && errno == EINTR)
+            continue;
+
+        if (result < 0) {
+            perror("gzoe: read");
+            exit(1);
+        }
+
+        if (result == 0)
+            break;
+
+        total += (uint32_t) result;
+    }
+
+    if (stream->checksum == CHECKSUM_CRC32)
+        stream->crc = crc_buffer(buffer, total, stream->crc);
+    else if (stream->checksum == CHECKSUM_ADLER32)
+        stream->adler = adler32(buffer, total, stream->adler);
+
+    stream->bytes_read += total;
+
+    return total;
+}
@@ -0,0 +1,34 @@
+/* input_stream.h
+
+   Definitions for an input stream which reads large chunks of input
+   and keeps track of the checksum and size of everything read so far.
+
+   Zoe Johnston - 2023/06/25
+*/ 
+
+#ifndef INPUT_STREAM_H
+#define INPUT_STREAM_H
+
+#include "stdio.h"
+#include "stdint.h"
+
+#define CHECKSUM_NONE 0
+#define CHECKSUM_CRC32 1
+#define CHECKSUM_ADLER32 2
+
+/* checksum selects whether crc (for gzip, the default) or adler (for zlib) is kept up to date. */
+typedef struct {
+    int input_fd;
+    uint32_t crc, adler, bytes_read;
+    int checksum;
+} input_stream_t;
+
+
+/* Initialize an input_stream_t structure. MUST be called before any of the below functions are used. */
+void input_stream_init(input_stream_t* stream, int input_fd);
+
+/* Read up to size bytes into buffer, returning the number of bytes read. Fewer than size bytes are 
+   only returned once the end of the input has been reached. */
+uint32_t input_stream_read(input_stream_t* stream, uint8_t* buffer, uint32_t size);
+
+#endif
@@ -12,62 +12,64 @@
 #include "stdint.h"
 #include "stdlib.h"
 #include "assert.h"
+#include "string.h"
 #include "lzss.h"
+#include "prefix_code.h"
 
-#define WINDOW_SIZE 33026
-#define FUTURE_SIZE 258
-#define PAST_SIZE 32768
-#define NIL 33026
+#if defined(__AVX2__)
+#include "immintrin.h"
+#elif defined(__SSE2__)
+#include "emmintrin.h"
+#endif
 
-/* Global variables */
+#define NIL 0
+#define MAX_CANDIDATES 8
+#define FAST_SKIP_RATE 32
+#define RUN_MAX_PERIOD 4
+#define INFINITE_COST UINT32_MAX
 
-uint16_t actual_future;
-uint16_t actual_past;
+/* Global variables */
 
 uint16_t distance_code_ranges[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
 uint16_t distance_offsets[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
 uint16_t length_code_ranges[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
 uint16_t length_offsets[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
 
-/* Function Declaration */
+// The length symbol minus 257 for every length up to 258 (lengths below 3 are unused)
+const uint8_t length_symbols[259] = {
+    0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15,
+    15, 15, 15, 16, 16, 16, 16, 16, 16, 16, 16, 17, 17, 17, 17, 17, 17, 17, 17, 18, 18, 18, 18, 18, 18, 18, 18, 19, 19, 19, 19, 19,
+    19, 19, 19, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21,
+    21, 21, 21, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,
+    23, 23, 23, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+    24, 24, 24, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+    25, 25, 25, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+    26, 26, 26, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27,
+    27, 27, 28
+};
+
+// The distance symbol for every distance up to 256, indexed by the distance minus one, followed by the symbol for 
+// every larger distance, indexed by 256 plus the distance minus one shifted right by 7
+const uint8_t distance_symbols[512] = {
+    0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7, 8, 8, 8, 8, 8, 8, 8, 8, 9, 9, 9, 9, 9, 9, 9, 9,
+    10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+    12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+    13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
+    14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+    14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    0, 14, 16, 17, 18, 18, 19, 19, 20, 20, 20, 20, 21, 21, 21, 21, 22, 22, 22, 22, 22, 22, 22, 22, 23, 23, 23, 23, 23, 23, 23, 23,
+    24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+    26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+    27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27,
+    28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+    29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29
+};
 
-/* Takes a length as a parameter and returns the symbol associated with it
- */
-uint16_t length_to_symbol(uint16_t length) {
-    for (unsigned int i = 0; i < 28; i++) {
-        if (length_code_ranges[i + 1] > length) 
-            return i + 257;
-    }
-
-    return 285;
-}
-
-/* Takes a distance as a parameter and returns the symbol associated with it
- */
-uint16_t distance_to_symbol(uint16_t distance) {
-    for (unsigned int i = 0; i < 29; i++) {
-        if (distance_code_ranges[i + 1] > distance) 
-            return i;
-    }
-
-    return 29;
-}
-
-/* Takes a length and the length symbol associated with that length minus 257 and returns 
- * the required offset value.
- */
-uint16_t length_offset(uint16_t length, uint16_t len_ind) {
-    uint16_t len_range_start = length_code_ranges[len_ind];
-    return length - len_range_start;
-}
-
-/* Takes a distance and the distance symbol associated with that distance and returns 
- * the required offset value.
- */
-uint16_t distance_offset(uint16_t distance, uint16_t dist_ind) {
-    uint16_t dist_range_start = distance_code_ranges[dist_ind];
-    return distance - dist_range_start;
-}
+/* Function Declaration */
 
 /* Takes either a length of distance symbol and returns the number of offset bits that follow it
  */
@@ -93,148 +95,461 @@ uint32_t length_bits(uint16_t symbol) {
     }
 }
 
-/* Initializes the sliding window. Pulls the first 258 characters into the sliding window buffer and
- * sets unused slots in the buffer and hash to NIL.
+/* Hashes the three characters starting at index into HASH_BITS bits.
+ */
+static inline uint32_t hash_three(window_t* window, uint32_t index) {
+    uint8_t* chars = window->chars + index;
+    uint32_t key = chars[0] | (chars[1] << 8) | (chars[2] << 16);
+
+    return (key * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Hashes the four characters starting at index into HASH_BITS bits.
+ */
+static inline uint32_t hash_four(window_t* window, uint32_t index) {
+    uint32_t key;
+
+    memcpy(&key, window->chars + index, 4);
+    return (key * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Initializes the sliding window. Sets the buffer to zeros, the hash and indices to NIL and the search parameters to 
+ * their defaults.
  */
 void window_init(window_t* window) {
     window->current = 0;
-    window->oldest = 0;
-    actual_past = 0;
-    actual_future = 0;
-    
-    for (uint32_t i = 0; i < 256; i++) {
-        window->hash[i] = NIL;
+    window->end = 0;
+    window->next_insert = 0;
+
+    lzss_set_level(window, DEFAULT_LEVEL);
+    window->has_model = 0;
+
+    memset(window->hash, NIL, sizeof(window->hash));
+    memset(window->indices, NIL, sizeof(window->indices));
+    memset(window->tree, NIL, sizeof(window->tree));
+    memset(window->chars, 0, sizeof(window->chars));
+}
+
+/* Moves the newest PAST_SIZE past characters and the future characters to the front of the buffer, and rebases the 
+ * hash and indices accordingly. Indices which fall out of the window become NIL.
+ */
+static void slide_window(window_t* window) {
+    uint16_t index;
+
+    memmove(window->chars, window->chars + PAST_SIZE, window->end - PAST_SIZE);
+    window->current -= PAST_SIZE;
+    window->end -= PAST_SIZE;
+    window->next_insert = (window->next_insert >= PAST_SIZE) ? window->next_insert - PAST_SIZE : 0;
+
+    for (unsigned int i = 0; i < HASH_SIZE; i++) {
+        index = window->hash[i];
+        window->hash[i] = (index >= PAST_SIZE) ? index - PAST_SIZE : NIL;
+    }
+
+    for (unsigned int i = 0; i < PAST_SIZE; i++) {
+        index = window->indices[i];
+        window->indices[i] = (index >= PAST_SIZE) ? index - PAST_SIZE : NIL;
     }
 
-    for (unsigned int i = 0; i < WINDOW_SIZE; i++) {
-        window->indices[i] = NIL;
-        window->chars[i] = 0;
+    if (window->params.match_finder == MATCH_FINDER_TREE) {
+        for (unsigned int i = 0; i < 2 * PAST_SIZE; i++) {
+            index = window->tree[i];
+            window->tree[i] = (index >= PAST_SIZE) ? index - PAST_SIZE : NIL;
+        }
     }
 }
 
-/* Enters the first WINDOW_SIZE characters into the sliding window. 
+/* Search parameters for each compression level, in the order max_attempts, nice_len, good_len, max_lazy, insert_len, 
+ * strategy, optimal_passes, match_finder and insert_policy. Level 1 uses the single candidate fast path and levels 2 
+ * and 3 parse greedily, with level 2 inserting only the first 8 characters of each backreference. Levels 4 to 8 parse 
+ * lazily and level 9 uses the optimal parse.
+ */
+static const lzss_params_t level_params[MAX_LEVEL + 1] = {
+    {0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, STRATEGY_FAST, 0, MATCH_FINDER_CHAIN, INSERT_ALL},
+    {8, 16, 4, 0, 8, STRATEGY_LAZY, 0, MATCH_FINDER_CHAIN, INSERT_FIRST},
+    {32, 32, 4, 0, 0, STRATEGY_LAZY, 0, MATCH_FINDER_CHAIN, INSERT_ALL},
+    {32, 32, 4, 4, 0, STRATEGY_LAZY, 0, MATCH_FINDER_CHAIN, INSERT_ALL},
+    {32, 32, 8, 16, 0, STRATEGY_LAZY, 0, MATCH_FINDER_CHAIN, INSERT_ALL},
+    {128, 128, 8, 16, 0, STRATEGY_LAZY, 0, MATCH_FINDER_CHAIN, INSERT_ALL},
+    {256, 128, 8, 32, 0, STRATEGY_LAZY, 0, MATCH_FINDER_CHAIN, INSERT_ALL},
+    {1024, 258, 32, 128, 0, STRATEGY_LAZY, 0, MATCH_FINDER_CHAIN, INSERT_ALL},
+    {64, 128, 0, 0, 0, STRATEGY_OPTIMAL, 2, MATCH_FINDER_TREE, INSERT_ALL}
+};
+
+/* Sets the search parameters of the window to those of the given compression level, from MIN_LEVEL (fastest) to 
+ * MAX_LEVEL (smallest output). Must be called before the first block is compressed, since the hash chain and binary 
+ * tree match finders cannot share a window.
  */
-void setup_future(window_t* window, uint8_t* contents, uint32_t block_size) {
-    uint32_t limit;
+void lzss_set_level(window_t* window, int level) {
+    assert(level >= MIN_LEVEL && level <= MAX_LEVEL);
+    window->params = level_params[level];
+}
 
-    if (FUTURE_SIZE < block_size) {
-        limit = FUTURE_SIZE;
-    } else {
-        limit = block_size;
+/* Slides the window if needed, then copies as much of the block as fits into the buffer if fewer than LOOKAHEAD future 
+ * characters remain. loaded is the number of characters of the block already copied. Returns the new value of loaded.
+ */
+uint32_t fill_window(window_t* window, uint8_t* contents, uint32_t block_size, uint32_t loaded) {
+    uint32_t num;
+
+    if (window->current >= 2 * PAST_SIZE)
+        slide_window(window);
+
+    if (window->end - window->current >= LOOKAHEAD || loaded == block_size)
+        return loaded;
+
+    num = WINDOW_SIZE - window->end;
+
+    if (num > block_size - loaded)
+        num = block_size - loaded;
+
+    memcpy(window->chars + window->end, contents + loaded, num);
+    window->end += num;
+
+    return loaded + num;
+}
+
+/* Returns the number of equal characters at the start of a and b, up to max_len. Compares 32 or 16 characters at a 
+ * time with AVX2 or SSE2 when compiled for them, then 8 at a time as words, then the rest one by one. Never reads 
+ * past max_len.
+ */
+static inline uint32_t match_length(uint8_t* a, uint8_t* b, uint32_t max_len) {
+    uint32_t len = 0;
+
+#if defined(__AVX2__)
+    while (len + 32 <= max_len) {
+        __m256i equal = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i*) (a + len)), _mm256_loadu_si256((__m256i*) (b + len)));
+        uint32_t mask = ~(uint32_t) _mm256_movemask_epi8(equal);
+
+        if (mask != 0)
+            return len + __builtin_ctz(mask);
+
+        len += 32;
+    }
+#elif defined(__SSE2__)
+    while (len + 16 <= max_len) {
+        __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i*) (a + len)), _mm_loadu_si128((__m128i*) (b + len)));
+        uint32_t mask = ~(uint32_t) _mm_movemask_epi8(equal) & 0xffff;
+
+        if (mask != 0)
+            return len + __builtin_ctz(mask);
+
+        len += 16;
     }
+#endif
 
-    for (unsigned int i = 0; i < limit; i++) {
-        window->chars[window->oldest] = contents[i];
-        window->oldest = (window->oldest + 1) % WINDOW_SIZE;
-        actual_future++;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t word_a, word_b;
+
+    while (len + 8 <= max_len) {
+        memcpy(&word_a, a + len, 8);
+        memcpy(&word_b, b + len, 8);
+
+        if (word_a != word_b)
+            return len + (__builtin_ctzll(word_a ^ word_b) >> 3);
+
+        len += 8;
     }
+#endif
+
+    while (len < max_len && a[len] == b[len])
+        len++;
+
+    return len;
 }
 
-/* Moves the sliding window forward by the amount provided in the parameter num. 
+/* A backreference found by the match finder.
+ */
+typedef struct {
+    uint16_t length;
+    uint16_t distance;
+} match_t;
+
+/* Inserts the current index into its binary tree, making it the root, and stores each backreference found on the way 
+ * down that is longer than all of those before it in the array pointed to by matches (at most MAX_CANDIDATES, 
+ * replacing the last one when full). Characters are only compared up to nice_len. A node which matches that far is 
+ * replaced by the current index, and the longest backreference is then extended up to max_len. 
+ *
+ * Near the end of the block max_len can be less than nice_len. A node which matches up to max_len then cannot be 
+ * ordered against the current index, so the rest of the tree is cut off there instead, which keeps the tree ordered.
+ * Returns the number of backreferences stored.
  */
-void move_window(window_t* window, uint8_t* contents, uint32_t block_size, uint32_t index, uint16_t num) {
-    uint8_t current_char, oldest_char;
+static uint32_t tree_search(window_t* window, uint32_t max_len, match_t* matches) {
+    uint32_t pos = window->current;
+    uint8_t* current = window->chars + pos;
+    // A candidate exactly PAST_SIZE back shares its node with the current index, so it is excluded
+    uint32_t limit = (pos >= PAST_SIZE) ? pos - PAST_SIZE + 1 : 0;
+    uint32_t tree_len = (max_len < window->params.nice_len) ? max_len : window->params.nice_len;
+    uint32_t current_hash = hash_three(window, pos);
+    uint32_t candidate = window->hash[current_hash];
+    uint16_t* smaller = &window->tree[2 * (pos & (PAST_SIZE - 1))];
+    uint16_t* larger = smaller + 1;
+    uint16_t* node;
+    uint32_t smaller_len = 0, larger_len = 0, len, num = 0, longest_len = 0;
+    int attempts = window->params.max_attempts;
+    uint8_t* match;
+
+    window->hash[current_hash] = pos;
+    window->next_insert = pos + 1;
+
+    while (candidate != NIL && candidate >= limit && attempts > 0 && tree_len > 0) {
+        node = &window->tree[2 * (candidate & (PAST_SIZE - 1))];
+        match = window->chars + candidate;
+
+        // Every string in this subtree shares at least the smaller of smaller_len and larger_len characters
+        len = (smaller_len < larger_len) ? smaller_len : larger_len;
+        len += match_length(match + len, current + len, tree_len - len);
+
+        if (len > longest_len && len >= 3 && matches != NULL) {
+            if (num == MAX_CANDIDATES)
+                num--;
+
+            matches[num].length = len;
+            matches[num].distance = pos - candidate;
+            num++;
+        }
 
-    for (unsigned int i = 0; i < num; i++) {
-        current_char = window->chars[window->current];
+        if (len > longest_len)
+            longest_len = len;
 
-        if (current_char < 256) {
-            window->indices[window->current] = window->hash[current_char];
-            window->hash[current_char] = window->current;
-        }
+        if (len == tree_len && tree_len < window->params.nice_len)
+            break;
 
-        window->current = (window->current + 1) % WINDOW_SIZE;
-        oldest_char = window->chars[window->oldest];
+        if (len == tree_len) {
+            *smaller = node[0];
+            *larger = node[1];
 
-        if (window->hash[oldest_char] == window->indices[window->oldest])
-            window->hash[oldest_char] = NIL;
-            
-        window->indices[window->oldest] = NIL;
+            if (num > 0 && matches[num - 1].length == tree_len) {
+                match = window->chars + pos - matches[num - 1].distance;
+                matches[num - 1].length += match_length(match + tree_len, current + tree_len, max_len - tree_len);
+            }
 
-        if (i + index < block_size) {
-            window->chars[window->oldest] = (uint16_t) contents[i + index];
-            window->oldest = (window->oldest + 1) % WINDOW_SIZE;
+            return num;
+        }
 
-        } else if (actual_future > 0) {
-            actual_future--;
+        if (match[len] < current[len]) {
+            *smaller = candidate;
+            smaller = node + 1;
+            smaller_len = len;
+            candidate = *smaller;
+        } else {
+            *larger = candidate;
+            larger = node;
+            larger_len = len;
+            candidate = *larger;
         }
 
-        if (actual_past < PAST_SIZE)
-            actual_past++;
+        attempts--;
+    }
+
+    *smaller = NIL;
+    *larger = NIL;
+
+    return num;
+}
+
+/* Inserts the current index into the hash chain or binary tree.
+ */
+static void insert_current(window_t* window) {
+    uint32_t current_hash, max_len;
+
+    if (window->params.match_finder == MATCH_FINDER_TREE) {
+        max_len = window->end - window->current;
+        tree_search(window, (max_len < FUTURE_SIZE) ? max_len : FUTURE_SIZE, NULL);
+        return;
+    }
+
+    current_hash = hash_three(window, window->current);
+    window->indices[window->current & (PAST_SIZE - 1)] = window->hash[current_hash];
+    window->hash[current_hash] = window->current;
+    window->next_insert = window->current + 1;
+}
+
+/* Moves the sliding window forward by the amount provided in the parameter num, inserting each character passed over 
+ * into the hash. 
+ */
+void move_window(window_t* window, uint16_t num) {
+    for (unsigned int i = 0; i < num; i++) {
+        if (window->current >= 2 * PAST_SIZE)
+            slide_window(window);
+
+        if (window->current >= window->next_insert)
+            insert_current(window);
+
+        window->current++;
+    }
+}
+
+/* Primes the window with a preset dictionary, so that backreferences can point into it from the start of the first 
+ * block. Only the last PAST_SIZE characters of the dictionary are used. Must be called after lzss_set_level and before 
+ * the first block is compressed.
+ */
+void lzss_set_dictionary(window_t* window, const uint8_t* dictionary, uint32_t size) {
+    assert(window->current == 0 && window->end == 0);
+
+    // An empty dictionary may come with a NULL pointer, which memcpy must not be given even for no characters
+    if (size == 0)
+        return;
+
+    if (size > PAST_SIZE) {
+        dictionary += size - PAST_SIZE;
+        size = PAST_SIZE;
+    }
+
+    memcpy(window->chars, dictionary, size);
+    window->end = size;
+
+    // Every index with four characters after it is inserted, the number the fast strategy hashes
+    for (uint32_t i = 0; i + 4 <= size; i++) {
+        window->current = i;
+
+        if (window->params.strategy == STRATEGY_FAST)
+            window->hash[hash_four(window, i)] = i;
+        else
+            insert_current(window);
+    }
+
+    window->current = size;
+    window->next_insert = size;
+}
+
+/* Moves the sliding window forward by num characters without inserting them.
+ */
+static void skip_window(window_t* window, uint16_t num) {
+    for (unsigned int i = 0; i < num; i++) {
+        if (window->current >= 2 * PAST_SIZE)
+            slide_window(window);
+
+        window->current++;
     }
 }
 
-/* Returns 1 if the current charcater and the two characters that follow it are respectively equal to the charcater at 
- * index most_recent_index and the two characters that follow it. Returns 0 otherwise. 
+/* Returns 1 if a backreference is a run, a repeat of at most RUN_MAX_PERIOD characters that is at least nice_len long.
  */
-int three_are_equal(window_t* window, uint16_t most_recent_index) {
-    return window->chars[(most_recent_index + 1) % WINDOW_SIZE] == window->chars[(window->current + 1) % WINDOW_SIZE]
-        && window->chars[(most_recent_index + 2) % WINDOW_SIZE] == window->chars[(window->current + 2) % WINDOW_SIZE];
+static inline int is_run(window_t* window, uint16_t distance, uint16_t length) {
+    return distance <= RUN_MAX_PERIOD && length >= window->params.nice_len;
 }
 
-/* Returns 0 if the character at index0 is equal to the character at index1, returns 1 otherwise.
+/* Moves the sliding window past a backreference, inserting the characters passed over into the hash as chosen by the 
+ * insertion policy (see lzss_params_t). Runs are never inserted, since they are found again without the hash.
  */
-int are_not_equal(window_t* window, uint16_t index0, uint16_t index1) {
-    return window->chars[index0 % WINDOW_SIZE] != window->chars[index1 % WINDOW_SIZE];
+static void move_past_backreference(window_t* window, uint16_t distance, uint16_t length) {
+    uint16_t num_inserted = length;
+
+    if (is_run(window, distance, length))
+        num_inserted = 0;
+    else if (window->params.insert_policy == INSERT_FIRST && length > window->params.insert_len)
+        num_inserted = window->params.insert_len;
+    else if (window->params.insert_policy == INSERT_UP_TO && length > window->params.insert_len)
+        num_inserted = 0;
+
+    move_window(window, num_inserted);
+    skip_window(window, length - num_inserted);
 }
 
-/* Computes the distance between the current index and the most recenty index
+/* Returns the length of the longest repeat of period 1 to RUN_MAX_PERIOD starting at the current index, up to max_len 
+ * (at least 4), and stores its period in the value pointed to by period. Returns 0 if the first four characters do not 
+ * repeat with any such period.
  */
-uint16_t compute_distance(window_t* window, uint16_t most_recent_index) {
-    int diff = (signed) window->current - most_recent_index;
-        
-    while (diff < 0)
-        diff += WINDOW_SIZE;
+static inline uint32_t run_length(window_t* window, uint32_t max_len, uint16_t* period) {
+    uint8_t* current = window->chars + window->current;
+    uint32_t word, prev_word, len, longest_len = 0;
+
+    *period = 0;
+    memcpy(&word, current, 4);
 
-    return (uint16_t) diff % WINDOW_SIZE;
+    for (unsigned int p = 1; p <= RUN_MAX_PERIOD && p <= window->current; p++) {
+        memcpy(&prev_word, current - p, 4);
+
+        if (prev_word != word)
+            continue;
+
+        len = 4 + match_length(current + 4 - p, current + 4, max_len - 4);
+
+        if (len > longest_len) {
+            longest_len = len;
+            *period = p;
+        }
+    }
+
+    return longest_len;
 }
 
-/* Locates a backreference. If no backreference is found, returns 0. Otherwise returns 1. Updates the values pointed to 
- * by distance and length with the disntace and length of the backreference. 
+/* Locates a backreference longer than min_len, which is the length of a backreference already held by the caller (or 
+ * 0). If no backreference is found, returns 0. Otherwise returns 1. Updates the values pointed to by distance and 
+ * length with the disntace and length of the backreference. 
  */
-int find_backreference(window_t* window, uint32_t num_left, uint16_t* distance, uint16_t* length) {
-    int attempts = 500; 
+int find_backreference(window_t* window, uint32_t num_left, uint16_t min_len, uint16_t* distance, uint16_t* length) {
+    int attempts = window->params.max_attempts; 
+    uint16_t period;
+    uint32_t run;
     
-    if (actual_past == 0 || num_left < 3)
+    if (num_left < 3)
         return 0;
 
-    uint16_t current_char = window->chars[window->current];
-    uint16_t most_recent_index = window->hash[current_char];
-    uint16_t longest_len = 0, longest_len_distance = 0;
-    uint16_t cur_len, cur_dist;
+    // A run is used as it is, without searching or inserting the current index
+    if (num_left >= 4) {
+        run = run_length(window, (num_left < FUTURE_SIZE) ? num_left : FUTURE_SIZE, &period);
 
-    while (most_recent_index != NIL && attempts > 0) {
-        if (window->chars[most_recent_index] != window->chars[window->current])
-            break;
+        if (run > min_len && is_run(window, period, run)) {
+            *distance = period;
+            *length = run;
+            return 1;
+        }
+    }
 
-        cur_dist = compute_distance(window, most_recent_index);
+    if (window->params.match_finder == MATCH_FINDER_TREE) {
+        match_t matches[MAX_CANDIDATES];
+        uint32_t num = tree_search(window, (num_left < FUTURE_SIZE) ? num_left : FUTURE_SIZE, matches);
 
-        if (cur_dist > PAST_SIZE || cur_dist > actual_past || cur_dist == 0) 
-            break;
+        if (num == 0 || matches[num - 1].length <= min_len)
+            return 0;
 
-        if (three_are_equal(window, most_recent_index)) {
-            for (cur_len = 3; cur_len < FUTURE_SIZE && cur_len < num_left; cur_len++) {
-                if (are_not_equal(window, most_recent_index + cur_len, window->current + cur_len))
-                    break;
-            }
+        *distance = matches[num - 1].distance;
+        *length = matches[num - 1].length;
+        return 1;
+    }
+
+    uint8_t* current = window->chars + window->current;
+    uint8_t* match;
+    uint32_t limit = (window->current > PAST_SIZE) ? window->current - PAST_SIZE : 0;
+    uint32_t max_len = (num_left < FUTURE_SIZE) ? num_left : FUTURE_SIZE;
+    uint32_t most_recent_index = window->hash[hash_three(window, window->current)];
+    uint16_t longest_len = min_len, longest_len_distance = 0;
+    uint16_t cur_len;
+
+    if (min_len >= max_len)
+        return 0;
+
+    // A good enough backreference is already held, so less effort is spent looking for a better one
+    if (min_len >= window->params.good_len && min_len > 0)
+        attempts = (attempts > 4) ? attempts >> 2 : 1;
+
+    while (most_recent_index != NIL && most_recent_index >= limit && attempts > 0) {
+        match = window->chars + most_recent_index;
+
+        // A candidate which differs at the current longest length cannot beat it, so that character is checked first
+        if (match[longest_len] == current[longest_len] && match[0] == current[0] && match[1] == current[1] 
+        && match[2] == current[2]) {
+            cur_len = 3 + match_length(match + 3, current + 3, max_len - 3);
 
-            if (cur_len > 50) {
-                *distance = cur_dist;
+            if (cur_len >= window->params.nice_len || cur_len == max_len) {
+                *distance = window->current - most_recent_index;
                 *length = cur_len;
                 return 1;
             }
             
             if (cur_len > longest_len) {
                 longest_len = cur_len;
-                longest_len_distance = cur_dist;
+                longest_len_distance = window->current - most_recent_index;
             }
         }
 
-        most_recent_index = window->indices[most_recent_index];
+        most_recent_index = window->indices[most_recent_index & (PAST_SIZE - 1)];
         attempts--;
     }
 
-    if (longest_len > 0 && longest_len_distance > 0) {
+    if (longest_len_distance > 0) {
         *length = longest_len;
         *distance = longest_len_distance;
         return 1;
@@ -243,48 +558,452 @@ int find_backreference(window_t* window, uint32_t num_left, uint16_t* distance,
     return 0;
 }
 
-/* Applies LZSS to the contents of the block pointed to by the contents parameter. Stores the result in the array 
- * pointed to by the storage parameter.
+/* Locates backreferences like find_backreference, but stores every backreference that is longer than all of those 
+ * before it in the array pointed to by matches, so lengths and distances are increasing. Keeps at most MAX_CANDIDATES, 
+ * replacing the last one when full. Returns the number stored.
  */
-uint32_t lzss(uint16_t* storage, window_t* window, uint8_t* contents, uint32_t block_size, uint32_t* bits_used_ptr) {
-    uint16_t distance_symbol, length_symbol, distance, length;
-    uint32_t bits_used = 0;
-    uint32_t i = 0, j = 0;
+uint32_t find_backreferences(window_t* window, uint32_t num_left, match_t* matches) {
+    int attempts = window->params.max_attempts; 
+    uint16_t period;
+    
+    if (num_left < 3)
+        return 0;
 
-    // Puts future characters into the sliding window
-    setup_future(window, contents, block_size);
+    // A run is the only candidate stored, without searching or inserting the current index
+    if (num_left >= 4) {
+        matches[0].length = run_length(window, (num_left < FUTURE_SIZE) ? num_left : FUTURE_SIZE, &period);
+
+        if (is_run(window, period, matches[0].length)) {
+            matches[0].distance = period;
+            return 1;
+        }
+    }
+
+    if (window->params.match_finder == MATCH_FINDER_TREE)
+        return tree_search(window, (num_left < FUTURE_SIZE) ? num_left : FUTURE_SIZE, matches);
+
+    uint8_t* current = window->chars + window->current;
+    uint8_t* match;
+    uint32_t limit = (window->current > PAST_SIZE) ? window->current - PAST_SIZE : 0;
+    uint32_t max_len = (num_left < FUTURE_SIZE) ? num_left : FUTURE_SIZE;
+    uint32_t most_recent_index = window->hash[hash_three(window, window->current)];
+    uint32_t num = 0;
+    uint16_t longest_len = 0;
+    uint16_t cur_len;
+
+    while (most_recent_index != NIL && most_recent_index >= limit && attempts > 0) {
+        match = window->chars + most_recent_index;
+
+        if (match[longest_len] == current[longest_len] && match[0] == current[0] && match[1] == current[1] 
+        && match[2] == current[2]) {
+            cur_len = 3 + match_length(match + 3, current + 3, max_len - 3);
+
+            if (cur_len > longest_len) {
+                if (num == MAX_CANDIDATES)
+                    num--;
+
+                matches[num].length = cur_len;
+                matches[num].distance = window->current - most_recent_index;
+                num++;
+                longest_len = cur_len;
+
+                if (cur_len >= window->params.nice_len || cur_len == max_len)
+                    break;
+            }
+        }
+
+        most_recent_index = window->indices[most_recent_index & (PAST_SIZE - 1)];
+        attempts--;
+    }
+
+    return num;
+}
+
+/* Stores a backreference in the array pointed to by storage at index j. Returns the index after it.
+ */
+static inline uint32_t push_backreference(token_t* storage, uint32_t j, uint16_t distance, uint16_t length, uint32_t* bits_used) {
+    uint16_t length_symbol = length_to_symbol(length);
+
+    storage[j] = TOKEN_BACKREFERENCE(length, distance);
+    *bits_used += length_bits(length_symbol) + 5 + offset_bits(length_symbol) + distance_offsets[distance_to_symbol(distance)];
+
+    return j + 1;
+}
+
+/* Stores a literal in the array pointed to by storage at index j. Returns the index after it.
+ */
+static inline uint32_t push_literal(token_t* storage, uint32_t j, uint8_t literal, uint32_t* bits_used) {
+    storage[j] = TOKEN_LITERAL(literal);
+    *bits_used += 8;
+
+    return j + 1;
+}
+
+/* Applies LZSS to the contents of the block pointed to by the contents parameter with greedy or lazy parsing. Stores 
+ * the result in the array pointed to by the storage parameter. A backreference found at one position is held back 
+ * while the next position is searched (see lzss_params_t), in which case the window sits one character past the held 
+ * backreference.
+ */
+static uint32_t lzss_lazy(token_t* storage, window_t* window, uint8_t* contents, uint32_t block_size, uint32_t* bits_used_ptr) {
+    uint16_t distance, length, prev_distance = 0, prev_length = 0;
+    uint32_t bits_used = 0;
+    uint32_t i = 0, j = 0, loaded = 0;
+    int found;
 
     // Iterates over the block while moving through the window 
     while (i < block_size) {
-        if (find_backreference(window, block_size - i, &distance, &length) == 1) {
-            distance_symbol = distance_to_symbol(distance);
-            length_symbol = length_to_symbol(length);
+        loaded = fill_window(window, contents, block_size, loaded);
+        assert(contents[i] == window->chars[window->current]);
+
+        found = find_backreference(window, block_size - i, prev_length, &distance, &length);
+
+        if (prev_length > 0 && (found == 0 || length <= prev_length)) {
+            // The held backreference starting at i - 1 is at least as long, so it is used
+            j = push_backreference(storage, j, prev_distance, prev_length, &bits_used);
+            move_past_backreference(window, prev_distance, prev_length - 1);
+            i += prev_length - 1;
+            prev_length = 0;
+
+        } else if (found == 1 && length < window->params.max_lazy && i + 1 < block_size) {
+            // Holds the backreference and moves on to check the next position
+            if (prev_length > 0)
+                j = push_literal(storage, j, contents[i - 1], &bits_used);
+
+            prev_distance = distance;
+            prev_length = length;
+            move_window(window, 1);
+            i++;
+
+        } else {
+            if (prev_length > 0)
+                j = push_literal(storage, j, contents[i - 1], &bits_used);
+
+            prev_length = 0;
+
+            if (found == 1) {
+                j = push_backreference(storage, j, distance, length, &bits_used);
+                move_past_backreference(window, distance, length);
+                i += length;
+
+            } else {
+                j = push_literal(storage, j, contents[i], &bits_used);
+                move_window(window, 1);
+                i++;
+            }
+        }
+    }
+
+    if (prev_length > 0) 
+        j = push_backreference(storage, j, prev_distance, prev_length, &bits_used);
+
+    *bits_used_ptr = bits_used;
+    return j;
+}
+
+/* Bit costs of every literal, match length and distance symbol under some prefix code. The length and distance costs 
+ * include their offset bits.
+ */
+typedef struct {
+    uint32_t literal[256];
+    uint32_t length[259];
+    uint32_t distance[30];
+} cost_model_t;
+
+/* Fills model from the given LL and distance code lengths.
+ */
+void setup_cost_model(cost_model_t* model, uint16_t* ll_lengths, uint16_t* dist_lengths) {
+    uint16_t symbol;
+
+    for (unsigned int i = 0; i < 256; i++)
+        model->literal[i] = ll_lengths[i];
+
+    for (unsigned int length = 3; length < 259; length++) {
+        symbol = length_to_symbol(length);
+        model->length[length] = ll_lengths[symbol] + offset_bits(symbol);
+    }
+
+    for (unsigned int i = 0; i < 30; i++)
+        model->distance[i] = dist_lengths[i] + offset_bits(i);
+}
+
+/* Fills ll_lengths and dist_lengths with the lengths of the default code used by block type 1.
+ */
+void default_code_lengths(uint16_t* ll_lengths, uint16_t* dist_lengths) {
+    for (unsigned int i = 0; i < 286; i++)
+        ll_lengths[i] = length_bits(i);
+
+    for (unsigned int i = 0; i < 30; i++)
+        dist_lengths[i] = 5;
+}
+
+/* Computes code lengths for the symbols in the array pointed to by storage. One is added to every frequency so that 
+ * symbols not used yet still get a finite cost.
+ */
+void model_code_lengths(token_t* storage, uint32_t size, uint16_t* ll_lengths, uint16_t* dist_lengths) {
+    uint32_t ll_frequencies[288] = {0};
+    uint32_t dist_frequencies[32] = {0};
+
+    get_frequencies(ll_frequencies, dist_frequencies, storage, size);
+
+    for (unsigned int i = 0; i < 286; i++)
+        ll_frequencies[i]++;
+
+    for (unsigned int i = 0; i < 30; i++)
+        dist_frequencies[i]++;
+
+    memset(ll_lengths, 0, 286 * sizeof(uint16_t));
+    memset(dist_lengths, 0, 30 * sizeof(uint16_t));
+    package_merge(15, 286, ll_frequencies, ll_lengths);
+    package_merge(15, 30, dist_frequencies, dist_lengths);
+}
+
+/* Finds the cheapest way to encode the block under model, given the candidates for each position, and stores it in the 
+ * array pointed to by storage. cost, path_length and path_distance must have room for block_size + 1 entries. Returns 
+ * the number of entries used in storage.
+ */
+uint32_t shortest_path(token_t* storage, uint8_t* contents, uint32_t block_size, match_t* matches, uint8_t* num_matches, 
+    uint16_t nice_len, cost_model_t* model, uint32_t* cost, uint16_t* path_length, uint16_t* path_distance, 
+    uint32_t* bits_used) {
+    uint32_t i, j = 0, next_cost, dist_cost;
+    uint16_t length, prev_len;
+    match_t* candidate;
+
+    cost[0] = 0;
+    path_length[0] = 0;
+    path_distance[0] = 0;
+
+    for (i = 1; i <= block_size; i++)
+        cost[i] = INFINITE_COST;
+
+    // Forward pass: relaxes the literal and every backreference length reachable from each position
+    for (i = 0; i < block_size; i++) {
+        next_cost = cost[i] + model->literal[contents[i]];
+
+        if (next_cost < cost[i + 1]) {
+            cost[i + 1] = next_cost;
+            path_length[i + 1] = 1;
+        }
+
+        prev_len = 2;
+
+        for (unsigned int k = 0; k < num_matches[i]; k++) {
+            candidate = &matches[i * MAX_CANDIDATES + k];
+            dist_cost = cost[i] + model->distance[distance_to_symbol(candidate->distance)];
+
+            // Each length up to that of the candidate can use its distance, the shortest one available for that length. 
+            // Only the full length of a candidate of at least nice_len is tried, which keeps long runs linear.
+            length = (candidate->length >= nice_len) ? candidate->length : prev_len + 1;
+
+            for (; length <= candidate->length; length++) {
+                next_cost = dist_cost + model->length[length];
+
+                if (next_cost < cost[i + length]) {
+                    cost[i + length] = next_cost;
+                    path_length[i + length] = length;
+                    path_distance[i + length] = candidate->distance;
+                }
+            }
+
+            prev_len = candidate->length;
+        }
+    }
+
+    // Backward pass: follows the path from the end of the block, moving each step to the position it starts at. The 
+    // step arriving at that position is read before it is overwritten.
+    uint16_t next_length, next_distance, distance;
+
+    i = block_size;
+    length = path_length[i];
+    distance = path_distance[i];
+
+    while (i > 0) {
+        i -= length;
+        next_length = path_length[i];
+        next_distance = path_distance[i];
+        path_length[i] = length;
+        path_distance[i] = distance;
+        length = next_length;
+        distance = next_distance;
+    }
+
+    // Walks the path forward again
+    *bits_used = 0;
+    i = 0;
+
+    while (i < block_size) {
+        length = path_length[i];
+
+        if (length == 1) {
+            j = push_literal(storage, j, contents[i], bits_used);
+        } else {
+            j = push_backreference(storage, j, path_distance[i], length, bits_used);
+        }
+
+        i += length;
+    }
+
+    return j;
+}
+
+/* Applies LZSS to the contents of the block with optimal parsing. Collects candidate backreferences at every position, 
+ * then runs shortest_path once per pass, rebuilding the cost model from the result of the previous pass. Falls back to 
+ * lazy parsing if memory cannot be allocated.
+ */
+static uint32_t lzss_optimal(token_t* storage, window_t* window, uint8_t* contents, uint32_t block_size, uint32_t* bits_used_ptr) {
+    match_t* matches = malloc((size_t) block_size * MAX_CANDIDATES * sizeof(match_t));
+    uint8_t* num_matches = malloc(block_size + 1);
+    uint32_t* cost = malloc((block_size + 1) * sizeof(uint32_t));
+    uint16_t* path_length = malloc((block_size + 1) * sizeof(uint16_t));
+    uint16_t* path_distance = malloc((block_size + 1) * sizeof(uint16_t));
+    uint32_t i, loaded = 0, j = 0, skip = 0;
+    uint16_t skip_length = 0, skip_distance = 0;
+    int in_run = 0;
+    cost_model_t model;
+
+    if (matches == NULL || num_matches == NULL || cost == NULL || path_length == NULL || path_distance == NULL) {
+        free(matches);
+        free(num_matches);
+        free(cost);
+        free(path_length);
+        free(path_distance);
+
+        return lzss_lazy(storage, window, contents, block_size, bits_used_ptr);
+    }
+
+    // Collects candidates while moving through the window. Positions inside a backreference of at least nice_len are 
+    // not searched; the rest of that backreference is their only candidate, except inside a run, where they 
+    // have no candidates and are not inserted.
+    for (i = 0; i < block_size; i++) {
+        loaded = fill_window(window, contents, block_size, loaded);
+        match_t* position_matches = &matches[i * MAX_CANDIDATES];
+
+        if (skip > 0) {
+            skip--;
+            skip_length--;
+            num_matches[i] = 0;
+
+            if (skip_length >= 3 && !in_run) {
+                position_matches[0].length = skip_length;
+                position_matches[0].distance = skip_distance;
+                num_matches[i] = 1;
+            }
+
+        } else {
+            num_matches[i] = find_backreferences(window, block_size - i, position_matches);
+            in_run = 0;
+
+            if (num_matches[i] > 0 && position_matches[num_matches[i] - 1].length >= window->params.nice_len) {
+                skip_length = position_matches[num_matches[i] - 1].length;
+                skip_distance = position_matches[num_matches[i] - 1].distance;
+                skip = skip_length - 1;
+                in_run = is_run(window, skip_distance, skip_length);
+            }
+        }
+
+        if (in_run)
+            skip_window(window, 1);
+        else
+            move_window(window, 1);
+    }
+
+    if (!window->has_model) {
+        default_code_lengths(window->model_ll_lengths, window->model_dist_lengths);
+        window->has_model = 1;
+    }
+
+    for (unsigned int pass = 0; pass < window->params.optimal_passes || pass == 0; pass++) {
+        if (pass > 0)
+            model_code_lengths(storage, j, window->model_ll_lengths, window->model_dist_lengths);
+
+        setup_cost_model(&model, window->model_ll_lengths, window->model_dist_lengths);
+        j = shortest_path(storage, contents, block_size, matches, num_matches, window->params.nice_len, &model, cost, 
+            path_length, path_distance, bits_used_ptr);
+    }
+
+    model_code_lengths(storage, j, window->model_ll_lengths, window->model_dist_lengths);
+
+    free(matches);
+    free(num_matches);
+    free(cost);
+    free(path_length);
+    free(path_distance);
+
+    return j;
+}
+
+/* Applies LZSS to the contents of the block pointed to by the contents parameter using a single candidate per position. 
+ * hash holds the most recent index at which each hash of four characters was seen, with no chains behind it. Every 
+ * FAST_SKIP_RATE positions in a row without a backreference, the number of characters passed over between candidates 
+ * grows by one, so incompressible data is skipped through quickly. Only the starting index and the index two before 
+ * the end of each backreference are inserted.
+ */
+static uint32_t lzss_fast(token_t* storage, window_t* window, uint8_t* contents, uint32_t block_size, uint32_t* bits_used_ptr) {
+    uint32_t bits_used = 0;
+    uint32_t i = 0, j = 0, loaded = 0, misses = 0;
+    uint32_t current_hash, candidate, limit, max_len, length, step, a, b;
+    uint8_t* current;
+
+    while (i < block_size) {
+        loaded = fill_window(window, contents, block_size, loaded);
+        assert(contents[i] == window->chars[window->current]);
 
-            // Because the length will always be at least 3, we can safely store the length and distance symbols and offsets
-            // in three array entries 
-            storage[j] = length_symbol;
-            storage[j + 1] = (length_offset(length, length_symbol - 257) << 5) | distance_symbol;
-            storage[j + 2] = distance_offset(distance, distance_symbol);
+        max_len = (block_size - i < FUTURE_SIZE) ? block_size - i : FUTURE_SIZE;
+        length = 0;
+
+        if (max_len >= 4) {
+            current = window->chars + window->current;
+            limit = (window->current > PAST_SIZE) ? window->current - PAST_SIZE : 0;
+            current_hash = hash_four(window, window->current);
+            candidate = window->hash[current_hash];
+            window->hash[current_hash] = window->current;
+
+            if (candidate != NIL && candidate >= limit) {
+                memcpy(&a, window->chars + candidate, 4);
+                memcpy(&b, current, 4);
+
+                if (a == b)
+                    length = 4 + match_length(window->chars + candidate + 4, current + 4, max_len - 4);
+            }
+        }
 
-            move_window(window, contents, block_size, i + FUTURE_SIZE, length);
+        if (length > 0) {
+            j = push_backreference(storage, j, window->current - candidate, length, &bits_used);
 
-            bits_used += length_bits(length_symbol) + 5 + offset_bits(length_symbol) + offset_bits(distance_symbol);
+            if (length >= 6 && block_size - i >= length + 2)
+                window->hash[hash_four(window, window->current + length - 2)] = window->current + length - 2;
 
-            j += 3;
+            window->current += length;
             i += length;
+            misses = 0;
 
         } else {
-            assert(contents[i] == window->chars[window->current]);
-            storage[j] = (uint16_t) window->chars[window->current];
-            move_window(window, contents, block_size, i + FUTURE_SIZE, 1);
+            step = 1 + (misses++ / FAST_SKIP_RATE);
 
-            bits_used += 8;
+            if (step > block_size - i)
+                step = block_size - i;
 
-            j++;
-            i++;
+            for (unsigned int k = 0; k < step; k++)
+                j = push_literal(storage, j, window->chars[window->current + k], &bits_used);
+
+            window->current += step;
+            i += step;
         }
     }
 
     *bits_used_ptr = bits_used;
     return j;
+}
+
+/* Applies LZSS to the contents of the block pointed to by the contents parameter, using the strategy set in the 
+ * window's parameters. Stores the result in the array pointed to by the storage parameter and the number of bits it 
+ * would take with block type 1 in the value pointed to by bits_used_ptr. Returns the number of entries used in storage.
+ */
+uint32_t lzss(token_t* storage, window_t* window, uint8_t* contents, uint32_t block_size, uint32_t* bits_used_ptr) {
+    if (window->params.strategy == STRATEGY_OPTIMAL)
+        return lzss_optimal(storage, window, contents, block_size, bits_used_ptr);
+
+    if (window->params.strategy == STRATEGY_FAST)
+        return lzss_fast(storage, window, contents, block_size, bits_used_ptr);
+
+    return lzss_lazy(storage, window, contents, block_size, bits_used_ptr);
 }
\ No newline at end of file
@@ -11,19 +11,116 @@
 #include "stdlib.h"
 #include "assert.h"
 
-/* A sliding window. The chars array stores the characters in the window.
+#define HASH_BITS 15
+#define HASH_SIZE (1 << HASH_BITS)
+#define PAST_SIZE 32768
+#define FUTURE_SIZE 258
+#define LOOKAHEAD (FUTURE_SIZE + 2)
+#define WINDOW_SIZE (2 * PAST_SIZE + LOOKAHEAD)
+
+#define STRATEGY_LAZY 0
+#define STRATEGY_OPTIMAL 1
+#define STRATEGY_FAST 2
+
+#define MATCH_FINDER_CHAIN 0
+#define MATCH_FINDER_TREE 1
+
+#define INSERT_ALL 0
+#define INSERT_FIRST 1
+#define INSERT_UP_TO 2
+
+#define MIN_LEVEL 1
+#define MAX_LEVEL 9
+#define DEFAULT_LEVEL 6
+
+/* Parameters controlling the search for backreferences. max_attempts bounds the number of candidates checked at each 
+ * position and the search stops early once a match of at least nice_len is found. 
+ *
+ * With STRATEGY_LAZY, when a match shorter than max_lazy is found, the next position is searched as well and a literal 
+ * is used instead if it has a longer match. That search checks only a quarter as many candidates when the held match 
+ * is at least good_len long. A max_lazy of 0 gives purely greedy parsing. With STRATEGY_OPTIMAL, every position is searched and 
+ * the cheapest sequence of literals and backreferences is chosen under a bit cost model, refined over optimal_passes 
+ * passes. STRATEGY_FAST ignores the other parameters and checks a single candidate per position, found through a hash 
+ * of four characters, skipping ahead faster the longer it goes without finding a backreference.
+ *
+ * insert_policy selects which of the characters covered by a backreference are inserted into the hash: INSERT_ALL 
+ * inserts every one, INSERT_FIRST only the first insert_len of them, and INSERT_UP_TO every one if the backreference 
+ * is at most insert_len long and none otherwise.
+ *
+ * match_finder selects how candidates are found. MATCH_FINDER_CHAIN walks the hash chain of the current position. 
+ * MATCH_FINDER_TREE keeps the positions with each hash in a binary search tree ordered by the characters that follow 
+ * them, and walks down it from the root, visiting at most max_attempts nodes.
  */
 typedef struct {
-    uint16_t hash[256];
-    uint16_t indices[33026];
-    uint8_t chars[33026];
+    uint16_t max_attempts;
+    uint16_t nice_len;
+    uint16_t good_len;
+    uint16_t max_lazy;
+    uint16_t insert_len;
+    uint8_t strategy;
+    uint8_t optimal_passes;
+    uint8_t match_finder;
+    uint8_t insert_policy;
+} lzss_params_t;
+
+/* A sliding window. The chars array is a linear buffer holding up to 2 * PAST_SIZE characters that have already been 
+ * processed followed by the future characters, with current the index of the current character and end the index 
+ * after the last future character. Once current reaches 2 * PAST_SIZE, the newest PAST_SIZE past characters are moved 
+ * to the front of the buffer. hash holds the most recent index at which each hash of three characters was seen and 
+ * indices links each index (modulo PAST_SIZE) to the previous one with the same hash. With MATCH_FINDER_TREE, hash 
+ * holds the root of each tree instead and tree holds the smaller and larger child of each index (modulo PAST_SIZE). 
+ * Every index before next_insert has been inserted.
+ */
+typedef struct {
+    uint16_t hash[HASH_SIZE];
+    uint16_t indices[PAST_SIZE];
+    uint16_t tree[2 * PAST_SIZE];
+    uint8_t chars[WINDOW_SIZE];
+
+    uint32_t current;
+    uint32_t end;
+    uint32_t next_insert;
 
-    uint16_t current;
-    uint16_t oldest;
+    lzss_params_t params;
+
+    // Code lengths chosen by the last optimal parse, used to seed the cost model of the next one
+    uint16_t model_ll_lengths[286];
+    uint16_t model_dist_lengths[30];
+    int has_model;
 } window_t;
 
+/* A literal or backreference produced by lzss. A literal is stored as its value. A backreference stores its length in 
+ * the low 16 bits and its distance in the high 16 bits, so a token is a literal exactly when its distance is 0.
+ */
+typedef uint32_t token_t;
+
+#define TOKEN_LITERAL(literal) ((token_t) (literal))
+#define TOKEN_BACKREFERENCE(length, distance) (((token_t) (distance) << 16) | (length))
+#define TOKEN_LENGTH(token) ((token) & 0xFFFF)
+#define TOKEN_DISTANCE(token) ((token) >> 16)
+
+extern uint16_t distance_code_ranges[30];
+extern uint16_t length_code_ranges[29];
+extern const uint8_t length_symbols[259];
+extern const uint8_t distance_symbols[512];
+
+/* Returns the symbol associated with a length from 3 to 258.
+ */
+static inline uint16_t length_to_symbol(uint16_t length) {
+    return 257 + length_symbols[length];
+}
+
+/* Returns the symbol associated with a distance from 1 to 32768. Distances up to 256 are looked up directly and larger 
+ * ones by their top bits, since every symbol past 15 covers a multiple of 128 distances.
+ */
+static inline uint16_t distance_to_symbol(uint16_t distance) {
+    return (distance <= 256) ? distance_symbols[distance - 1] : distance_symbols[256 + ((distance - 1) >> 7)];
+}
+
 void window_init(window_t* window);
+void lzss_set_level(window_t* window, int level);
+void lzss_set_dictionary(window_t* window, const uint8_t* dictionary, uint32_t size);
 uint16_t offset_bits(uint16_t symbol);
-uint32_t lzss(uint16_t* storage, window_t* window, uint8_t* contents, uint32_t block_size, uint32_t* bits_used_ptr);
+uint32_t lzss(token_t* storage, window_t* window, uint8_t* contents, uint32_t block_size, uint32_t* bits_used_ptr);
 
 #endif 
\ No newline at end of file
@@ -8,13 +8,42 @@
 
 
 #include "stdio.h"
+#include "stdlib.h"
 #include "stdint.h"
+#include "string.h"
 #include "output_stream.h"
 
-static void output_byte(bitstream_t *stream){
-    fputc((unsigned char) stream->bitvec, stream->output_file);
-    stream->bitvec = 0;
-    stream->numbits = 0;
+/* Appends size bytes of data to the memory of a stream without an output file, doubling its capacity as needed.
+ */
+static void output_memory(bitstream_t* stream, const uint8_t* data, size_t size) {
+    if (stream->memory_size + size > stream->memory_capacity) {
+        while (stream->memory_size + size > stream->memory_capacity)
+            stream->memory_capacity = (stream->memory_capacity == 0) ? OUTPUT_BUFFER_SIZE : stream->memory_capacity * 2;
+
+        stream->memory = realloc(stream->memory, stream->memory_capacity);
+
+        if (stream->memory == NULL) {
+            fprintf(stderr, "gzoe: out of memory\n");
+            exit(1);
+        }
+    }
+
+    memcpy(stream->memory + stream->memory_size, data, size);
+    stream->memory_size += size;
+}
+
+/* Moves every complete byte in the accumulator into the output buffer. Only used once the 
+   accumulator has been padded to a byte boundary.
+ */
+static void output_bytes(bitstream_t *stream){
+    while (stream->numbits >= 8) {
+        if (stream->buffer_used == OUTPUT_BUFFER_SIZE)
+            bitstream_flush_buffer(stream);
+
+        stream->buffer[stream->buffer_used++] = (uint8_t) stream->bitvec;
+        stream->bitvec >>= 8;
+        stream->numbits -= 8;
+    }
 }
 
 /* Initialize an bitstream_t structure. MUST be called before any of the below functions are used. */
@@ -22,11 +51,34 @@ void bitstream_init(bitstream_t* stream, FILE* output_file){
     stream->output_file = output_file;
     stream->numbits = 0;
     stream->bitvec = 0;
+    stream->buffer_used = 0;
+    stream->memory = NULL;
+    stream->memory_size = 0;
+    stream->memory_capacity = 0;
+}
+
+/* Initialize a bitstream_t structure which collects its output in memory. */
+void bitstream_init_memory(bitstream_t* stream){
+    bitstream_init(stream, NULL);
 }
 
+/* Write out any remaining bits (padded to a byte) and the contents of the output buffer */
 void bitstream_finalize(bitstream_t* stream){
-    if (stream->numbits > 0)
-        output_byte(stream);
+    bitstream_flush_to_byte(stream);
+    bitstream_flush_buffer(stream);
+
+    if (stream->output_file != NULL)
+        fflush(stream->output_file);
+}
+
+/* Write the contents of the output buffer to the output file */
+void bitstream_flush_buffer(bitstream_t* stream){
+    if (stream->buffer_used > 0 && stream->output_file != NULL)
+        fwrite(stream->buffer, 1, stream->buffer_used, stream->output_file);
+    else if (stream->buffer_used > 0)
+        output_memory(stream, stream->buffer, stream->buffer_used);
+
+    stream->buffer_used = 0;
 }
 
 /* Push an entire byte into the stream, with the least significant bit pushed first */
@@ -44,32 +96,40 @@ void bitstream_push_u16(bitstream_t* stream, uint16_t i){
     bitstream_push_bits(stream, i, 16);
 }
 
-/* Push the lowest order num_bits bits from b into the stream
-   with the least significant bit pushed first */
-void bitstream_push_bits(bitstream_t* stream, unsigned int b, unsigned int num_bits){
-    for(unsigned int i = 0; i < num_bits; i++)
-        bitstream_push_bit(stream, (b >> i) & 1);
+/* Push a 32 bit unsigned integer value with its most significant byte first, as zlib stores them */
+void bitstream_push_u32_be(bitstream_t* stream, uint32_t i){
+    bitstream_push_byte(stream, i >> 24);
+    bitstream_push_byte(stream, i >> 16);
+    bitstream_push_byte(stream, i >> 8);
+    bitstream_push_byte(stream, i);
 }
 
 /* Push the lowest order num_bits bits from b into the stream
    with the most significant bit pushed first*/
 void bitstream_push_encoding(bitstream_t* stream, unsigned int b, unsigned int num_bits) {
-    for(int i = num_bits - 1; i >= 0; i--) {
-        bitstream_push_bit(stream, (b >> (unsigned int) i) & 1);
+    unsigned int reversed = 0;
+
+    for(unsigned int i = 0; i < num_bits; i++) {
+        reversed = (reversed << 1) | (b & 1);
+        b >>= 1;
     }
-}
 
-/* Push a single bit b (stored as the LSB of an unsigned int)
-    into the stream */ 
-void bitstream_push_bit(bitstream_t* stream, unsigned int b){
-    stream->bitvec |= (b & 1) << stream->numbits;
-    stream->numbits++;
-    if (stream->numbits == 8)
-        output_byte(stream);
+    bitstream_push_bits(stream, reversed, num_bits);
 }
 
 /* Flush the currently stored bits to the output stream */
 void bitstream_flush_to_byte(bitstream_t* stream){
-    if (stream->numbits > 0)
-        output_byte(stream);
-}
\ No newline at end of file
+    stream->numbits = (stream->numbits + 7) & ~7u;
+    output_bytes(stream);
+}
+
+/* Pad to a byte boundary, then write size bytes of data which is already encoded */
+void bitstream_push_bytes(bitstream_t* stream, const uint8_t* data, size_t size){
+    bitstream_flush_to_byte(stream);
+    bitstream_flush_buffer(stream);
+
+    if (stream->output_file != NULL)
+        fwrite(data, 1, size, stream->output_file);
+    else
+        output_memory(stream, data, size);
+}
@@ -13,17 +13,35 @@
 #include "stdio.h"
 #include "stdint.h"
 
+#define OUTPUT_BUFFER_SIZE (1<<16)
+
+/* Bits are collected LSB first in a 64 bit accumulator. Whenever at least 32 bits are
+   pending, the low 32 bits are written as a little endian word into the output buffer,
+   which is passed to the output file once it is full. A stream without an output file
+   collects its output in memory instead, which grows as needed and belongs to the caller. */
 typedef struct {
-    uint32_t bitvec, numbits;
+    uint64_t bitvec;
+    uint32_t numbits;
+    uint32_t buffer_used;
+    uint8_t buffer[OUTPUT_BUFFER_SIZE];
     FILE* output_file;
+    uint8_t* memory;
+    size_t memory_size, memory_capacity;
 } bitstream_t;
 
 
 /* Initialize an bitstream_t structure. MUST be called before any of the below functions are used. */
 void bitstream_init(bitstream_t* stream, FILE* output_file);
 
+/* Initialize a bitstream_t structure which collects its output in memory. */
+void bitstream_init_memory(bitstream_t* stream);
+
+/* Write out any remaining bits (padded to a byte) and the contents of the output buffer */
 void bitstream_finalize(bitstream_t* stream);
 
+/* Write the contents of the output buffer to the output file */
+void bitstream_flush_buffer(bitstream_t* stream);
+
 /* Push an entire byte into the stream, with the least significant bit pushed first */
 void bitstream_push_byte(bitstream_t* stream, unsigned char b);
 
@@ -33,19 +51,54 @@ void bitstream_push_u32(bitstream_t* stream, uint32_t i);
 /* Push a 16 bit unsigned integer value (LSB first) */
 void bitstream_push_u16(bitstream_t* stream, uint16_t i);
 
-/* Push the lowest order num_bits bits from b into the stream
-   with the least significant bit pushed first */
-void bitstream_push_bits(bitstream_t* stream, unsigned int b, unsigned int num_bits);
+/* Push a 32 bit unsigned integer value with its most significant byte first, as zlib stores them */
+void bitstream_push_u32_be(bitstream_t* stream, uint32_t i);
 
 /* Push the lowest order num_bits bits from b into the stream
    with the most significant bit pushed first*/
 void bitstream_push_encoding(bitstream_t* stream, unsigned int b, unsigned int num_bits);
 
-/* Push a single bit b (stored as the LSB of an unsigned int)
-    into the stream */ 
-void bitstream_push_bit(bitstream_t* stream, unsigned int b);
-
 /* Flush the currently stored bits to the output stream */
 void bitstream_flush_to_byte(bitstream_t* stream);
 
-#endif 
\ No newline at end of file
+/* Pad to a byte boundary, then write size bytes of data which is already encoded */
+void bitstream_push_bytes(bitstream_t* stream, const uint8_t* data, size_t size);
+
+/* Moves 32 complete bits from the accumulator into the output buffer. Only called
+   by bitstream_push_bits once numbits has reached 32. */
+static inline void bitstream_output_word(bitstream_t* stream) {
+    uint8_t* out;
+
+    if (stream->buffer_used + 4 > OUTPUT_BUFFER_SIZE)
+        bitstream_flush_buffer(stream);
+
+    out = stream->buffer + stream->buffer_used;
+    out[0] = (uint8_t) stream->bitvec;
+    out[1] = (uint8_t) (stream->bitvec >> 8);
+    out[2] = (uint8_t) (stream->bitvec >> 16);
+    out[3] = (uint8_t) (stream->bitvec >> 24);
+
+    stream->buffer_used += 4;
+    stream->bitvec >>= 32;
+    stream->numbits -= 32;
+}
+
+/* Push the lowest order num_bits bits from b into the stream
+   with the least significant bit pushed first. num_bits must be at most 32. */
+static inline void bitstream_push_bits(bitstream_t* stream, unsigned int b, unsigned int num_bits) {
+    uint64_t mask = ((uint64_t) 1 << num_bits) - 1;
+
+    stream->bitvec |= ((uint64_t) b & mask) << stream->numbits;
+    stream->numbits += num_bits;
+
+    if (stream->numbits >= 32)
+        bitstream_output_word(stream);
+}
+
+/* Push a single bit b (stored as the LSB of an unsigned int)
+    into the stream */ 
+static inline void bitstream_push_bit(bitstream_t* stream, unsigned int b) {
+    bitstream_push_bits(stream, b, 1);
+}
+
+#endif
@@ -0,0 +1,309 @@
+/* parallel.c
+
+   Definitions of the functions declared in parallel.h
+
+   The main thread reads the input into a ring of chunks, each holding the 32K of input
+   before it as history. Worker threads take the chunks in order, compress them into
+   memory and mark them done. Once the ring is full, the main thread waits for the oldest
+   chunk, writes its output and combines its checksum before reading the next chunk into
+   its place, so at most two chunks per thread are held at once.
+
+   In BGZF mode, every chunk is instead compressed on its own into a complete gzip member.
+
+   Zoe Johnston - 2023/06/25
+*/
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "assert.h"
+#include "stdint.h"
+#include "string.h"
+#include "pthread.h"
+#include "output_stream.h"
+#include "input_stream.h"
+#include "lzss.h"
+#include "deflate.h"
+#include "CRC_for_C.h"
+#include "adler32.h"
+#include "parallel.h"
+
+#define CHUNKS_PER_THREAD 2
+
+/* A chunk of the input. contents holds history_size characters of history followed by the size characters of the
+ * chunk. last is set for the final chunk of the input, and done once stream holds its output and check its checksum.
+ */
+typedef struct {
+    uint8_t* contents;
+    uint32_t history_size, size;
+    uint32_t check;
+    int last, done;
+    bitstream_t stream;
+} chunk_t;
+
+/* The state shared by the main thread and the workers. Chunks are numbered in the order they are read and chunk
+ * number n is stored at chunks[n % num_chunks]. Workers take chunks from next_taken up to next_queued. All fields
+ * after lock are protected by it.
+ */
+typedef struct {
+    chunk_t* chunks;
+    unsigned int num_chunks;
+    int level, checksum, bgzf;
+
+    pthread_mutex_t lock;
+    pthread_cond_t queued, finished;
+    uint64_t next_queued, next_taken;
+    int stopping;
+} pool_t;
+
+/* Compresses size characters of data into stream as a run of blocks of at most MAX_BLOCK_SIZE characters each, with 
+ * the window reset and primed with up to 32K of history. Unless last is set, the data ends with a sync flush instead 
+ * of a final block, so that another chunk can follow it.
+ */
+void deflate_chunk(bitstream_t* stream, window_t* window, int level, const uint8_t* history, uint32_t history_size, 
+    uint8_t* data, uint32_t size, int last) {
+    uint32_t num_blocks = (size + MAX_BLOCK_SIZE - 1) / (MAX_BLOCK_SIZE);
+    uint32_t position = 0, block_size;
+
+    window_init(window);
+    lzss_set_level(window, level);
+    lzss_set_dictionary(window, history, history_size);
+
+    // Equal blocks rather than full ones followed by a short remainder
+    if (num_blocks == 0)
+        num_blocks = 1;
+
+    for (uint32_t i = 0; i < num_blocks; i++) {
+        block_size = (size - position) / (num_blocks - i);
+        bitstream_push_bit(stream, last && i == num_blocks - 1);
+        write_block(stream, window, data + position, block_size);
+        position += block_size;
+    }
+
+    if (!last)
+        push_sync_flush(stream);
+}
+
+/* Compresses a chunk into its stream in memory and computes its checksum.
+ */
+static void compress_chunk(window_t* window, chunk_t* chunk, int level, int checksum) {
+    uint8_t* data = chunk->contents + chunk->history_size;
+
+    bitstream_init_memory(&chunk->stream);
+    deflate_chunk(&chunk->stream, window, level, chunk->contents, chunk->history_size, data, chunk->size, chunk->last);
+    bitstream_finalize(&chunk->stream);
+
+    if (checksum == CHECKSUM_CRC32)
+        chunk->check = crc_buffer(data, chunk->size, 0);
+    else if (checksum == CHECKSUM_ADLER32)
+        chunk->check = adler32(data, chunk->size, ADLER32_INIT);
+}
+
+/* Compresses a chunk into its stream in memory as a BGZF member with an empty window. If it does not fit in a member, 
+ * which only happens when the data cannot be compressed, it is stored instead.
+ */
+static void compress_member(window_t* window, chunk_t* chunk, int level) {
+    uint32_t crc = crc_buffer(chunk->contents, chunk->size, 0);
+    uint8_t* memory;
+
+    bitstream_init_memory(&chunk->stream);
+    push_bgzf_header(&chunk->stream, level, BGZF_MAX_MEMBER_SIZE);
+    deflate_chunk(&chunk->stream, window, level, NULL, 0, chunk->contents, chunk->size, 1);
+    push_trailer(&chunk->stream, FORMAT_GZIP, crc, 0, chunk->size);
+    bitstream_finalize(&chunk->stream);
+
+    if (chunk->stream.memory_size > BGZF_MAX_MEMBER_SIZE) {
+        free(chunk->stream.memory);
+        bitstream_init_memory(&chunk->stream);
+        push_bgzf_header(&chunk->stream, level, BGZF_MAX_MEMBER_SIZE);
+        bitstream_push_bit(&chunk->stream, 1);
+        block_0(&chunk->stream, chunk->contents, chunk->size);
+        push_trailer(&chunk->stream, FORMAT_GZIP, crc, 0, chunk->size);
+        bitstream_finalize(&chunk->stream);
+    }
+
+    // The size is only known now, so it is patched into the header
+    memory = chunk->stream.memory;
+    memory[BGZF_HEADER_SIZE - 2] = (uint8_t) (chunk->stream.memory_size - 1);
+    memory[BGZF_HEADER_SIZE - 1] = (uint8_t) ((chunk->stream.memory_size - 1) >> 8);
+}
+
+/* Takes queued chunks in order and compresses them until the pool is stopped and nothing is left.
+ */
+static void* worker(void* arg) {
+    pool_t* pool = arg;
+    window_t* window = malloc(sizeof(window_t));
+    chunk_t* chunk;
+
+    assert(window != NULL);
+    pthread_mutex_lock(&pool->lock);
+
+    while (1) {
+        while (pool->next_taken == pool->next_queued && !pool->stopping)
+            pthread_cond_wait(&pool->queued, &pool->lock);
+
+        if (pool->next_taken == pool->next_queued)
+            break;
+
+        chunk = &pool->chunks[pool->next_taken++ % pool->num_chunks];
+        pthread_mutex_unlock(&pool->lock);
+
+        if (pool->bgzf)
+            compress_member(window, chunk, pool->level);
+        else
+            compress_chunk(window, chunk, pool->level, pool->checksum);
+
+        pthread_mutex_lock(&pool->lock);
+        chunk->done = 1;
+        pthread_cond_broadcast(&pool->finished);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+    free(window);
+    return NULL;
+}
+
+/* Waits for a chunk to be compressed, then pushes its output to stream and folds its checksum into the input's. Empty 
+ * BGZF members are left out, as the end of file marker is one.
+ */
+static void write_chunk(pool_t* pool, chunk_t* chunk, bitstream_t* stream, input_stream_t* input) {
+    pthread_mutex_lock(&pool->lock);
+
+    while (!chunk->done)
+        pthread_cond_wait(&pool->finished, &pool->lock);
+
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!pool->bgzf || chunk->size > 0)
+        bitstream_push_bytes(stream, chunk->stream.memory, chunk->stream.memory_size);
+
+    free(chunk->stream.memory);
+
+    if (pool->checksum == CHECKSUM_CRC32)
+        input->crc = crc_combine(input->crc, chunk->check, chunk->size);
+    else if (pool->checksum == CHECKSUM_ADLER32)
+        input->adler = adler32_combine(input->adler, chunk->check, chunk->size);
+}
+
+/* Splits the rest of the input into chunks of chunk_size bytes and compresses them on num_threads threads, as DEFLATE
+ * data primed with the input before each chunk or, if bgzf is set, as independent BGZF members.
+ */
+static void run_pool(bitstream_t* stream, input_stream_t* input, int level, const uint8_t* dictionary,
+    uint32_t dictionary_size, unsigned int num_threads, uint32_t chunk_size, int bgzf) {
+    pool_t pool;
+    pthread_t threads[MAX_THREADS];
+    unsigned int num_started = 0;
+    const uint8_t* history = dictionary;
+    uint32_t history_size = dictionary_size;
+    chunk_t* chunk;
+
+    assert(num_threads >= 1 && num_threads <= MAX_THREADS);
+
+    pool.num_chunks = CHUNKS_PER_THREAD * num_threads;
+    pool.chunks = calloc(pool.num_chunks, sizeof(chunk_t));
+    pool.level = level;
+    pool.checksum = input->checksum;
+    pool.bgzf = bgzf;
+    pool.next_queued = 0;
+    pool.next_taken = 0;
+    pool.stopping = 0;
+
+    assert(pool.chunks != NULL);
+
+    for (unsigned int i = 0; i < pool.num_chunks; i++) {
+        pool.chunks[i].contents = malloc(PAST_SIZE + chunk_size);
+        assert(pool.chunks[i].contents != NULL);
+    }
+
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.queued, NULL);
+    pthread_cond_init(&pool.finished, NULL);
+
+    for (unsigned int i = 0; i < num_threads; i++) {
+        if (pthread_create(&threads[num_started], NULL, worker, &pool) == 0)
+            num_started++;
+    }
+
+    if (num_started == 0) {
+        fprintf(stderr, "gzoe: could not start any threads\n");
+        exit(1);
+    }
+
+    // The workers compute each chunk's checksum instead of the reads
+    input->checksum = CHECKSUM_NONE;
+
+    for (uint64_t n = 0; ; n++) {
+        chunk = &pool.chunks[n % pool.num_chunks];
+
+        if (n >= pool.num_chunks)
+            write_chunk(&pool, chunk, stream, input);
+
+        if (history_size > PAST_SIZE) {
+            history += history_size - PAST_SIZE;
+            history_size = PAST_SIZE;
+        }
+
+        if (history_size > 0)
+            memcpy(chunk->contents, history, history_size);
+        chunk->history_size = history_size;
+        chunk->size = input_stream_read(input, chunk->contents + history_size, chunk_size);
+        chunk->last = chunk->size < chunk_size;
+        chunk->done = 0;
+
+        pthread_mutex_lock(&pool.lock);
+        pool.next_queued++;
+        pthread_cond_signal(&pool.queued);
+        pthread_mutex_unlock(&pool.lock);
+
+        if (chunk->last)
+            break;
+
+        if (bgzf)
+            continue;
+
+        history = chunk->contents;
+        history_size = chunk->history_size + chunk->size;
+    }
+
+    // Write out the chunks still in the ring, oldest first
+    for (uint64_t n = (pool.next_queued > pool.num_chunks) ? pool.next_queued - pool.num_chunks : 0;
+        n < pool.next_queued; n++)
+        write_chunk(&pool, &pool.chunks[n % pool.num_chunks], stream, input);
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stopping = 1;
+    pthread_cond_broadcast(&pool.queued);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (unsigned int i = 0; i < num_started; i++)
+        pthread_join(threads[i], NULL);
+
+    input->checksum = pool.checksum;
+
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.queued);
+    pthread_cond_destroy(&pool.finished);
+
+    for (unsigned int i = 0; i < pool.num_chunks; i++)
+        free(pool.chunks[i].contents);
+
+    free(pool.chunks);
+}
+
+/* Compresses the rest of the input as DEFLATE data on num_threads threads and pushes it to stream, which must be at a
+ * byte boundary. The input is split into chunks of chunk_size bytes, each of which is compressed with the 32K of input
+ * before it (or the dictionary, for the first chunk) as history and ends at a byte boundary. The output therefore
+ * only depends on chunk_size, not on num_threads. The checksum selected by input is kept up to date as if the input
+ * had been read by a single thread.
+ */
+void deflate_parallel(bitstream_t* stream, input_stream_t* input, int level, const uint8_t* dictionary,
+    uint32_t dictionary_size, unsigned int num_threads, uint32_t chunk_size) {
+    run_pool(stream, input, level, dictionary, dictionary_size, num_threads, chunk_size, 0);
+}
+
+/* Compresses the rest of the input on num_threads threads as a BGZF file: a gzip member for every BGZF_BLOCK_SIZE 
+ * bytes, each compressed with an empty window and recording its own size, followed by the end of file marker.
+ */
+void bgzf_parallel(bitstream_t* stream, input_stream_t* input, int level, unsigned int num_threads) {
+    run_pool(stream, input, level, NULL, 0, num_threads, BGZF_BLOCK_SIZE, 1);
+    push_bgzf_eof(stream);
+}
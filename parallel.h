@@ -0,0 +1,43 @@
+/* parallel.h
+
+   Compression of the input in independent chunks on a pool of threads, in the manner of pigz,
+   or as BGZF members.
+
+   Zoe Johnston - 2023/06/25
+*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "stdio.h"
+#include "stdint.h"
+#include "output_stream.h"
+#include "input_stream.h"
+#include "lzss.h"
+
+#define MAX_THREADS 64
+#define DEFAULT_CHUNK_SIZE (128 * 1024)
+#define MIN_CHUNK_SIZE (32 * 1024)
+#define MAX_CHUNK_SIZE (16 * 1024 * 1024)
+
+/* Compresses size characters of data into stream, with the window reset and primed with up to 32K of history. Unless 
+ * last is set, the data ends at a byte boundary without a final block, so that another chunk can follow it.
+ */
+void deflate_chunk(bitstream_t* stream, window_t* window, int level, const uint8_t* history, uint32_t history_size, 
+    uint8_t* data, uint32_t size, int last);
+
+/* Compresses the rest of the input as DEFLATE data on num_threads threads and pushes it to stream, which must be at a
+ * byte boundary. The input is split into chunks of chunk_size bytes, each of which is compressed with the 32K of input
+ * before it (or the dictionary, for the first chunk) as history and ends at a byte boundary. The output therefore
+ * only depends on chunk_size, not on num_threads. The checksum selected by input is kept up to date as if the input
+ * had been read by a single thread.
+ */
+void deflate_parallel(bitstream_t* stream, input_stream_t* input, int level, const uint8_t* dictionary,
+    uint32_t dictionary_size, unsigned int num_threads, uint32_t chunk_size);
+
+/* Compresses the rest of the input on num_threads threads as a BGZF file: a gzip member for every BGZF_BLOCK_SIZE 
+ * bytes, each compressed with an empty window and recording its own size, followed by the end of file marker.
+ */
+void bgzf_parallel(bitstream_t* stream, input_stream_t* input, int level, unsigned int num_threads);
+
+#endif
@@ -0,0 +1,364 @@
+/* pipeline.c
+
+   Definitions of the functions declared in pipeline.h
+
+   The reader fills input blocks, the compressor turns them into LZSS tokens and the
+   encoder (the calling thread) writes each one as a DEFLATE block. The stages are joined
+   by single producer, single consumer rings which need no locks: each ring's tail is only
+   written by its producer and its head only by its consumer. A stage with nothing to do
+   spins briefly, then yields its CPU until the other side catches up.
+
+   In rsyncable mode, the reader also ends blocks where a rolling hash of the last 64
+   characters has its top RSYNC_BITS bits clear. The window is reset after each such
+   block and the output is padded to a byte with an empty stored block, so the
+   compressed bytes of a region between two boundaries only depend on that region.
+
+   Zoe Johnston - 2023/06/25
+*/
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "assert.h"
+#include "stdint.h"
+#include "string.h"
+#include "time.h"
+#include "sched.h"
+#include "threads.h"
+#include "stdatomic.h"
+#include "pthread.h"
+#include "output_stream.h"
+#include "input_stream.h"
+#include "lzss.h"
+#include "deflate.h"
+#include "pipeline.h"
+
+#define RING_SLOTS 4
+#define RSYNC_BITS 16
+#define RSYNC_MIN_SIZE 8192
+#define SPIN_LIMIT 64
+#define YIELD_LIMIT 256
+#define SLEEP_NS 50000
+
+#define STAGE_READ 0
+#define STAGE_COMPRESS 1
+#define STAGE_ENCODE 2
+
+/* Slots are numbered in the order they are filled and slot n is stored at index n % RING_SLOTS. Slots from head up
+ * to tail are full.
+ */
+typedef struct {
+    _Atomic uint32_t head, tail;
+} ring_t;
+
+/* A block of input. last is set for the final block and boundary for a block which ends at a content-defined 
+ * boundary. */
+typedef struct {
+    uint8_t contents[MAX_BLOCK_SIZE];
+    uint32_t size;
+    int last, boundary;
+} input_block_t;
+
+/* A block of input together with its LZSS output, which is enough to encode it. */
+typedef struct {
+    uint8_t contents[MAX_BLOCK_SIZE];
+    token_t tokens[MAX_BLOCK_SIZE];
+    uint32_t size, num_tokens, bits_used;
+    int last, boundary;
+} token_block_t;
+
+/* The state shared by the three stages. blocked and total hold the nanoseconds each stage spent waiting and running.
+ * The reader keeps the carry_size characters it has read but not yet put in a block in carry, and the rolling hash 
+ * with the number of characters it has covered since the last boundary.
+ */
+typedef struct {
+    ring_t inputs, outputs;
+    input_block_t input_blocks[RING_SLOTS];
+    token_block_t token_blocks[RING_SLOTS];
+    bitstream_t* stream;
+    window_t* window;
+    input_stream_t* input;
+    pipeline_options_t* options;
+    uint64_t blocked[3], total[3];
+
+    uint8_t carry[MAX_BLOCK_SIZE];
+    uint32_t carry_size;
+    int at_end;
+    uint64_t hash;
+    uint32_t since_boundary;
+} pipeline_t;
+
+// Random values for the rolling hash, one per character
+static uint64_t gear[256];
+
+/* Fills gear from a fixed seed, so that the boundaries are the same on every run. */
+static void setup_gear() {
+    uint64_t state = 0x9E3779B97F4A7C15, value;
+
+    for (int i = 0; i < 256; i++) {
+        state += 0x9E3779B97F4A7C15;
+        value = state;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EB;
+        gear[i] = value ^ (value >> 31);
+    }
+}
+
+/* Returns the current time in nanoseconds. */
+static uint64_t now() {
+    struct timespec time;
+    timespec_get(&time, TIME_UTC);
+    return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+/* Waits for the other end of a ring after spins unsuccessful checks: not at all at first, then by yielding the CPU, 
+ * then by sleeping so that a long wait (such as for a slow input) does not keep a CPU busy.
+ */
+static inline void ring_pause(unsigned int spins) {
+    struct timespec sleep = {0, SLEEP_NS};
+
+    if (spins >= SPIN_LIMIT + YIELD_LIMIT)
+        thrd_sleep(&sleep, NULL);
+    else if (spins >= SPIN_LIMIT)
+        sched_yield();
+}
+
+/* Waits until the producer of ring has an empty slot, adding the time spent waiting to blocked.
+ */
+static void ring_wait_free(ring_t* ring, uint64_t* blocked) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint64_t start;
+
+    if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) < RING_SLOTS)
+        return;
+
+    start = now();
+
+    for (unsigned int spins = 0; tail - atomic_load_explicit(&ring->head, memory_order_acquire) >= RING_SLOTS; spins++)
+        ring_pause(spins);
+
+    *blocked += now() - start;
+}
+
+/* Waits until the consumer of ring has a full slot, adding the time spent waiting to blocked.
+ */
+static void ring_wait_full(ring_t* ring, uint64_t* blocked) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint64_t start;
+
+    if (atomic_load_explicit(&ring->tail, memory_order_acquire) != head)
+        return;
+
+    start = now();
+
+    for (unsigned int spins = 0; atomic_load_explicit(&ring->tail, memory_order_acquire) == head; spins++)
+        ring_pause(spins);
+
+    *blocked += now() - start;
+}
+
+/* Returns the index of the oldest full slot of ring, for its consumer. */
+static inline uint32_t ring_head(ring_t* ring) {
+    return atomic_load_explicit(&ring->head, memory_order_relaxed) % RING_SLOTS;
+}
+
+/* Returns the index of the oldest empty slot of ring, for its producer. */
+static inline uint32_t ring_tail(ring_t* ring) {
+    return atomic_load_explicit(&ring->tail, memory_order_relaxed) % RING_SLOTS;
+}
+
+/* Hands the next slot of ring to its consumer. */
+static inline void ring_publish(ring_t* ring) {
+    atomic_store_explicit(&ring->tail, atomic_load_explicit(&ring->tail, memory_order_relaxed) + 1,
+        memory_order_release);
+}
+
+/* Hands the oldest slot of ring back to its producer. */
+static inline void ring_release(ring_t* ring) {
+    atomic_store_explicit(&ring->head, atomic_load_explicit(&ring->head, memory_order_relaxed) + 1,
+        memory_order_release);
+}
+
+/* Moves the rolling hash over the size characters at data, stopping after the first content-defined boundary. Returns 
+ * the number of characters covered, and sets found if they end at a boundary. The hash depends on the last 64 
+ * characters only, so the boundaries resynchronize soon after an edit.
+ */
+static uint32_t find_boundary(pipeline_t* pipeline, const uint8_t* data, uint32_t size, int* found) {
+    uint64_t hash = pipeline->hash;
+    uint32_t i;
+
+    *found = 0;
+
+    for (i = 0; i < size && !*found; i++) {
+        hash = (hash << 1) + gear[data[i]];
+        *found = ++pipeline->since_boundary >= RSYNC_MIN_SIZE && (hash >> (64 - RSYNC_BITS)) == 0;
+    }
+
+    if (*found)
+        pipeline->since_boundary = 0;
+
+    pipeline->hash = hash;
+    return i;
+}
+
+/* Reads up to MAX_BLOCK_SIZE characters into a block, after whatever was carried over from the last one. In 
+ * rsyncable mode the block ends at the first boundary and the rest is carried over. Reads ahead when nothing is 
+ * carried over, so that the last block can be marked as final.
+ */
+static void fill_block(pipeline_t* pipeline, input_block_t* block) {
+    uint32_t size = pipeline->carry_size, wanted;
+
+    memcpy(block->contents, pipeline->carry, size);
+    pipeline->carry_size = 0;
+
+    if (!pipeline->at_end) {
+        wanted = MAX_BLOCK_SIZE - size;
+        size += input_stream_read(pipeline->input, block->contents + size, wanted);
+        pipeline->at_end = size < MAX_BLOCK_SIZE;
+    }
+
+    block->boundary = 0;
+
+    if (pipeline->options->rsyncable) {
+        uint32_t length = find_boundary(pipeline, block->contents, size, &block->boundary);
+
+        memcpy(pipeline->carry, block->contents + length, size - length);
+        pipeline->carry_size = size - length;
+        size = length;
+    }
+
+    if (pipeline->carry_size == 0 && !pipeline->at_end) {
+        pipeline->carry_size = input_stream_read(pipeline->input, pipeline->carry, MAX_BLOCK_SIZE);
+        pipeline->at_end = pipeline->carry_size < MAX_BLOCK_SIZE;
+    }
+
+    block->size = size;
+    block->last = pipeline->at_end && pipeline->carry_size == 0;
+}
+
+/* Reads the input into blocks until the last one.
+ */
+static void* read_stage(void* arg) {
+    pipeline_t* pipeline = arg;
+    uint64_t start = now();
+    input_block_t* block;
+    int last;
+
+    do {
+        ring_wait_free(&pipeline->inputs, &pipeline->blocked[STAGE_READ]);
+        block = &pipeline->input_blocks[ring_tail(&pipeline->inputs)];
+
+        fill_block(pipeline, block);
+        last = block->last;
+        ring_publish(&pipeline->inputs);
+    } while (!last);
+
+    pipeline->total[STAGE_READ] = now() - start;
+    return NULL;
+}
+
+/* Runs LZSS on each input block, copying its contents along with the tokens for block type 0. The window is emptied 
+ * after a block which ends at a boundary. Even a dictionary cannot be put back, since the decoder would take it for 
+ * the output before the boundary.
+ */
+static void* compress_stage(void* arg) {
+    pipeline_t* pipeline = arg;
+    pipeline_options_t* options = pipeline->options;
+    uint64_t start = now();
+    input_block_t* input;
+    token_block_t* output;
+    int last;
+
+    do {
+        ring_wait_full(&pipeline->inputs, &pipeline->blocked[STAGE_COMPRESS]);
+        ring_wait_free(&pipeline->outputs, &pipeline->blocked[STAGE_COMPRESS]);
+        input = &pipeline->input_blocks[ring_head(&pipeline->inputs)];
+        output = &pipeline->token_blocks[ring_tail(&pipeline->outputs)];
+
+        memcpy(output->contents, input->contents, input->size);
+        output->size = input->size;
+        output->last = last = input->last;
+        output->boundary = input->boundary;
+        ring_release(&pipeline->inputs);
+
+        output->num_tokens = lzss(output->tokens, pipeline->window, output->contents, output->size,
+            &output->bits_used);
+
+        if (output->boundary) {
+            window_init(pipeline->window);
+            lzss_set_level(pipeline->window, options->level);
+        }
+
+        ring_publish(&pipeline->outputs);
+    } while (!last);
+
+    pipeline->total[STAGE_COMPRESS] = now() - start;
+    return NULL;
+}
+
+/* Encodes and writes each block of tokens, padding the output to a byte after a block which ends at a boundary.
+ */
+static void encode_stage(pipeline_t* pipeline) {
+    uint64_t start = now();
+    token_block_t* block;
+    int last;
+
+    do {
+        ring_wait_full(&pipeline->outputs, &pipeline->blocked[STAGE_ENCODE]);
+        block = &pipeline->token_blocks[ring_head(&pipeline->outputs)];
+
+        bitstream_push_bit(pipeline->stream, block->last);
+        encode_block(pipeline->stream, block->contents, block->size, block->tokens, block->num_tokens,
+            block->bits_used);
+
+        if (block->boundary && !block->last)
+            push_sync_flush(pipeline->stream);
+
+        last = block->last;
+        ring_release(&pipeline->outputs);
+    } while (!last);
+
+    pipeline->total[STAGE_ENCODE] = now() - start;
+}
+
+/* Compresses the rest of the input as a single DEFLATE stream, continuing from the window, and pushes it to stream.
+ * Outside rsyncable mode the blocks are the same as those written by a single thread.
+ */
+void deflate_pipelined(bitstream_t* stream, window_t* window, input_stream_t* input, pipeline_options_t* options) {
+    pipeline_t* pipeline = calloc(1, sizeof(pipeline_t));
+    pthread_t reader, compressor;
+    char* names[3] = {"read", "compress", "encode"};
+
+    assert(pipeline != NULL);
+    atomic_init(&pipeline->inputs.head, 0);
+    atomic_init(&pipeline->inputs.tail, 0);
+    atomic_init(&pipeline->outputs.head, 0);
+    atomic_init(&pipeline->outputs.tail, 0);
+    pipeline->stream = stream;
+    pipeline->window = window;
+    pipeline->input = input;
+    pipeline->options = options;
+    setup_gear();
+
+    if (pthread_create(&reader, NULL, read_stage, pipeline) != 0
+        || pthread_create(&compressor, NULL, compress_stage, pipeline) != 0) {
+        fprintf(stderr, "gzoe: could not start the pipeline threads\n");
+        exit(1);
+    }
+
+    encode_stage(pipeline);
+
+    pthread_join(reader, NULL);
+    pthread_join(compressor, NULL);
+
+    if (options->stats) {
+        fprintf(stderr, "gzoe: blocked");
+
+        for (int i = STAGE_READ; i <= STAGE_ENCODE; i++)
+            fprintf(stderr, "%s %s %.3fs of %.3fs", (i == STAGE_READ) ? "" : ",", names[i],
+                pipeline->blocked[i] / 1e9, pipeline->total[i] / 1e9);
+
+        fprintf(stderr, "\n");
+    }
+
+    free(pipeline);
+}
@@ -0,0 +1,32 @@
+/* pipeline.h
+
+   Compression of the input as a single DEFLATE stream by three threads: one reading the
+   input and computing its checksum, one running LZSS and one encoding and writing blocks.
+
+   Zoe Johnston - 2023/06/25
+*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "stdio.h"
+#include "stdint.h"
+#include "output_stream.h"
+#include "input_stream.h"
+#include "lzss.h"
+
+/* How the pipeline compresses. In rsyncable mode, blocks also end at boundaries chosen by the content, after which the 
+ * window is emptied and set to the given level. If stats is set, a line with the time each stage spent waiting on the 
+ * others is printed to stderr.
+ */
+typedef struct {
+    int level;
+    int rsyncable, stats;
+} pipeline_options_t;
+
+/* Compresses the rest of the input as a single DEFLATE stream, continuing from the window, and pushes it to stream.
+ * Outside rsyncable mode the blocks are the same as those written by a single thread.
+ */
+void deflate_pipelined(bitstream_t* stream, window_t* window, input_stream_t* input, pipeline_options_t* options);
+
+#endif
@@ -10,28 +10,28 @@
 #include "assert.h"
 #include "string.h"
 #include "prefix_code.h"
+#include "lzss.h"
 
 /* Function Declaration */
 
-/* Counts the number of occurences of each ll symbol in the array pointed to by contents, storing the results in 
-   ll_storage. Adds one to the count for symbol 256. Counts the number of occurences of each distance symbol in 
+/* Counts the number of occurences of each ll symbol in the array of tokens pointed to by contents, storing the results 
+   in ll_storage. Adds one to the count for symbol 256. Counts the number of occurences of each distance symbol in 
    the array pointed to by contents, storing the results in dist_storage.
  */
-void get_frequencies(uint32_t* ll_storage, uint32_t* dist_storage, uint16_t* contents, uint32_t size) {
-    uint16_t current;
-    unsigned int i = 0;
+void get_frequencies(uint32_t* ll_storage, uint32_t* dist_storage, uint32_t* contents, uint32_t size) {
+    token_t token;
+    uint16_t distance;
 
-    while (i  < size) {
-        current = contents[i];
-        ll_storage[current]++;
+    for (unsigned int i = 0; i < size; i++) {
+        token = contents[i];
+        distance = TOKEN_DISTANCE(token);
 
-        if (current > 256) {
-            current = contents[i + 1];
-            dist_storage[current & 31]++;
-            i += 2;
+        if (distance == 0) {
+            ll_storage[token]++;
+        } else {
+            ll_storage[length_to_symbol(TOKEN_LENGTH(token))]++;
+            dist_storage[distance_to_symbol(distance)]++;
         }
-
-        i++;
     }
 
     ll_storage[256]++;
@@ -99,8 +99,22 @@ int frequency_analysis(uint32_t* ll_storage, uint32_t* dist_storage) {
     }
 }
 
+/* Reverses the order of the lowest num_bits bits of code.
+ */
+uint16_t reverse_bits(uint16_t code, uint16_t num_bits) {
+    uint16_t reversed = 0;
+
+    for (unsigned int i = 0; i < num_bits; i++) {
+        reversed = (reversed << 1) | (code & 1);
+        code >>= 1;
+    }
+
+    return reversed;
+}
+
 /* The algorithm used in this function follows the pseudocode in RFC 1951.
-   Code provided by Bill Bird.
+   Code provided by Bill Bird. The resulting codes are stored bit-reversed, so that they can be pushed
+   LSB first with bitstream_push_bits.
  */
 void construct_canonical_code(uint16_t num_symbols, uint16_t lengths[], uint16_t result_codes[]) {
     uint16_t length_counts[16] = {0};
@@ -130,7 +144,7 @@ void construct_canonical_code(uint16_t num_symbols, uint16_t lengths[], uint16_t
         for(unsigned int symbol = 0; symbol < num_symbols; symbol++){
             unsigned int length = lengths[symbol];
             if (length > 0)
-                result_codes[symbol] = next_code[length]++;
+                result_codes[symbol] = reverse_bits(next_code[length]++, length);
         }  
     } 
 }
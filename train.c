@@ -0,0 +1,417 @@
+/* train.c
+
+   Builds a preset dictionary for gzoe -D from a directory of sample files.
+
+   The samples are compressed one after another as a single stream, so the match finder
+   looks for backreferences from each sample into the ones before it. Every byte that a
+   backreference into an earlier sample copies earns that sample a point. The dictionary
+   is then assembled from the segments of the samples with the most points, skipping
+   segments whose contents are already in the dictionary.
+
+   Zoe Johnston - 2023/06/25
+*/
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "assert.h"
+#include "stdint.h"
+#include "string.h"
+#include "dirent.h"
+#include "sys/stat.h"
+#include "output_stream.h"
+#include "lzss.h"
+#include "deflate.h"
+
+#define SEGMENT_SIZE 128
+#define SEGMENT_STEP 16
+#define KMER_SIZE 8
+#define KMER_BITS 22
+#define DEFAULT_HOLDOUT 5
+
+/* Options given on the command line. One in every holdout samples is set aside to measure the dictionary with instead
+ * of being trained on.
+ */
+typedef struct {
+    char* directory;
+    char* output;
+    uint32_t dictionary_size;
+    int level;
+    unsigned int holdout;
+} train_options_t;
+
+/* A set of samples stored one after another. starts holds the index of the first character of each sample in
+ * contents, followed by the total size.
+ */
+typedef struct {
+    uint8_t* contents;
+    uint32_t* starts;
+    uint32_t num_samples;
+    uint32_t size;
+} samples_t;
+
+/* A segment of the training samples which could be copied into the dictionary, with its score.
+ */
+typedef struct {
+    uint32_t start;
+    uint32_t score;
+} segment_t;
+
+/* Prints how to use the trainer and exits with an error.
+ */
+void usage(char* name) {
+    fprintf(stderr, "Usage: %s [-o dictionary] [-s size] [-1 ... -9] [-t holdout] sample_directory\n", name);
+    fprintf(stderr, "  -o is the file the dictionary is written to (default dictionary.bin)\n");
+    fprintf(stderr, "  -s is the largest dictionary size in bytes (default and at most %d)\n", PAST_SIZE);
+    fprintf(stderr, "  -1 ... -9 is the level the samples are compressed with (default -%d)\n", DEFAULT_LEVEL);
+    fprintf(stderr, "  -t sets aside one in every holdout samples to report on (default %d)\n", DEFAULT_HOLDOUT);
+    exit(1);
+}
+
+/* Parses the command line into options, exiting with the usage message if it is not valid.
+ */
+void parse_options(train_options_t* options, int argc, char** argv) {
+    char* arg;
+
+    options->directory = NULL;
+    options->output = "dictionary.bin";
+    options->dictionary_size = PAST_SIZE;
+    options->level = DEFAULT_LEVEL;
+    options->holdout = DEFAULT_HOLDOUT;
+
+    for (int i = 1; i < argc; i++) {
+        arg = argv[i];
+
+        if (arg[0] == '-' && arg[1] >= '0' + MIN_LEVEL && arg[1] <= '0' + MAX_LEVEL && arg[2] == '\0')
+            options->level = arg[1] - '0';
+        else if (strcmp(arg, "-o") == 0 && i + 1 < argc)
+            options->output = argv[++i];
+        else if (strcmp(arg, "-s") == 0 && i + 1 < argc)
+            options->dictionary_size = (uint32_t) strtoul(argv[++i], NULL, 10);
+        else if (strcmp(arg, "-t") == 0 && i + 1 < argc)
+            options->holdout = (unsigned int) strtoul(argv[++i], NULL, 10);
+        else if (arg[0] != '-' && options->directory == NULL)
+            options->directory = arg;
+        else
+            usage(argv[0]);
+    }
+
+    if (options->directory == NULL || options->dictionary_size == 0 || options->dictionary_size > PAST_SIZE
+    || options->holdout < 2)
+        usage(argv[0]);
+}
+
+/* Appends the contents of the file at path to samples. Exits with an error if the file cannot be read.
+ */
+void add_sample(samples_t* samples, char* path, uint32_t file_size) {
+    FILE* file = fopen(path, "rb");
+
+    samples->contents = realloc(samples->contents, (size_t) samples->size + file_size);
+    samples->starts = realloc(samples->starts, (samples->num_samples + 2) * sizeof(uint32_t));
+
+    if (file == NULL || samples->contents == NULL || samples->starts == NULL) {
+        perror(path);
+        exit(1);
+    }
+
+    if (fread(samples->contents + samples->size, 1, file_size, file) != file_size) {
+        perror(path);
+        exit(1);
+    }
+
+    fclose(file);
+    samples->starts[samples->num_samples] = samples->size;
+    samples->num_samples++;
+    samples->size += file_size;
+    samples->starts[samples->num_samples] = samples->size;
+}
+
+/* Compares two file names for qsort.
+ */
+int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+/* Reads every regular file in the directory, in order of name, sending one in every holdout of them to held_out and
+ * the rest to training.
+ */
+void read_samples(char* directory, unsigned int holdout, samples_t* training, samples_t* held_out) {
+    DIR* dir = opendir(directory);
+    struct dirent* entry;
+    struct stat info;
+    char** names = NULL;
+    char path[4096];
+    uint32_t num_names = 0;
+
+    if (dir == NULL) {
+        perror(directory);
+        exit(1);
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        names = realloc(names, (num_names + 1) * sizeof(char*));
+        names[num_names] = malloc(strlen(entry->d_name) + 1);
+
+        if (names == NULL || names[num_names] == NULL) {
+            perror(directory);
+            exit(1);
+        }
+
+        strcpy(names[num_names++], entry->d_name);
+    }
+
+    closedir(dir);
+    qsort(names, num_names, sizeof(char*), compare_names);
+
+    memset(training, 0, sizeof(samples_t));
+    memset(held_out, 0, sizeof(samples_t));
+
+    for (uint32_t i = 0, num_files = 0; i < num_names; i++) {
+        snprintf(path, sizeof(path), "%s/%s", directory, names[i]);
+
+        if (stat(path, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0 && info.st_size < UINT32_MAX / 2) {
+            add_sample((num_files % holdout == holdout - 1) ? held_out : training, path, (uint32_t) info.st_size);
+            num_files++;
+        }
+
+        free(names[i]);
+    }
+
+    free(names);
+}
+
+/* Compresses the samples one after another as a single stream and adds one to gains for every character that a
+ * backreference copies from an earlier sample, at the index it is copied from.
+ */
+void collect_gains(samples_t* samples, int level, uint32_t* gains) {
+    token_t* storage = malloc(MAX_BLOCK_SIZE * sizeof(token_t));
+    window_t* window = malloc(sizeof(window_t));
+    uint32_t position = 0, block_size, num_tokens, bits_used, sample = 0, distance, length;
+
+    assert(storage != NULL && window != NULL);
+    window_init(window);
+    lzss_set_level(window, level);
+
+    while (position < samples->size) {
+        block_size = (samples->size - position < MAX_BLOCK_SIZE) ? samples->size - position : MAX_BLOCK_SIZE;
+        num_tokens = lzss(storage, window, samples->contents + position, block_size, &bits_used);
+
+        for (uint32_t i = 0; i < num_tokens; i++) {
+            distance = TOKEN_DISTANCE(storage[i]);
+            length = (distance == 0) ? 1 : TOKEN_LENGTH(storage[i]);
+
+            while (samples->starts[sample + 1] <= position)
+                sample++;
+
+            if (distance > 0 && position - distance < samples->starts[sample]) {
+                for (uint32_t k = 0; k < length; k++)
+                    gains[position - distance + k]++;
+            }
+
+            position += length;
+        }
+    }
+
+    free(storage);
+    free(window);
+}
+
+/* Hashes the KMER_SIZE characters at data into KMER_BITS bits.
+ */
+static inline uint32_t hash_kmer(uint8_t* data) {
+    uint64_t key;
+
+    memcpy(&key, data, KMER_SIZE);
+    return (uint32_t) ((key * 0x9E3779B97F4A7C15ull) >> (64 - KMER_BITS));
+}
+
+/* Returns the score of the segment starting at start: the gains of its characters, not counting those that start a
+ * run of KMER_SIZE characters already in the dictionary (according to the bit array seen).
+ */
+uint32_t score_segment(samples_t* samples, uint32_t* gains, uint8_t* seen, uint32_t start) {
+    uint32_t score = 0, kmer;
+
+    for (uint32_t i = start; i < start + SEGMENT_SIZE; i++) {
+        if (i + KMER_SIZE <= samples->size) {
+            kmer = hash_kmer(samples->contents + i);
+
+            if (seen[kmer >> 3] & (1 << (kmer & 7)))
+                continue;
+        }
+
+        score += gains[i];
+    }
+
+    return score;
+}
+
+/* Moves the segment at index down the max-heap of num segments until it is no smaller than its children.
+ */
+void sift_down(segment_t* heap, uint32_t num, uint32_t index) {
+    segment_t segment = heap[index];
+    uint32_t child;
+
+    while ((child = 2 * index + 1) < num) {
+        if (child + 1 < num && heap[child + 1].score > heap[child].score)
+            child++;
+
+        if (heap[child].score <= segment.score)
+            break;
+
+        heap[index] = heap[child];
+        index = child;
+    }
+
+    heap[index] = segment;
+}
+
+/* Fills the array pointed to by dictionary with up to size characters taken from the segments of the samples with
+ * the highest scores. Since a segment's score can only fall as the dictionary grows, the scores are only recomputed for
+ * the segment at the top of the heap. The segments chosen first are stored last, closest to the data that will follow
+ * the dictionary. Returns the number of characters used.
+ */
+uint32_t build_dictionary(samples_t* samples, uint32_t* gains, uint8_t* dictionary, uint32_t size) {
+    uint32_t num = 0, used = 0, score, kmer;
+    segment_t* heap = malloc((samples->size / SEGMENT_STEP + 1) * sizeof(segment_t));
+    uint8_t* seen = calloc(1 << (KMER_BITS - 3), 1);
+
+    assert(heap != NULL && seen != NULL);
+
+    for (uint32_t s = 0; s < samples->num_samples; s++) {
+        for (uint32_t start = samples->starts[s]; start + SEGMENT_SIZE <= samples->starts[s + 1]; start += SEGMENT_STEP) {
+            heap[num].start = start;
+            heap[num].score = score_segment(samples, gains, seen, start);
+            num++;
+        }
+    }
+
+    for (uint32_t i = num / 2; i-- > 0;)
+        sift_down(heap, num, i);
+
+    while (num > 0 && used + SEGMENT_SIZE <= size) {
+        score = score_segment(samples, gains, seen, heap[0].start);
+
+        // Another segment may now be better than the stale score at the top
+        if (score < heap[0].score) {
+            heap[0].score = score;
+            sift_down(heap, num, 0);
+            continue;
+        }
+
+        if (score == 0)
+            break;
+
+        used += SEGMENT_SIZE;
+        memcpy(dictionary + size - used, samples->contents + heap[0].start, SEGMENT_SIZE);
+
+        for (uint32_t i = heap[0].start; i + KMER_SIZE <= heap[0].start + SEGMENT_SIZE; i++) {
+            kmer = hash_kmer(samples->contents + i);
+            seen[kmer >> 3] |= 1 << (kmer & 7);
+        }
+
+        heap[0] = heap[--num];
+        sift_down(heap, num, 0);
+    }
+
+    memmove(dictionary, dictionary + size - used, used);
+
+    free(heap);
+    free(seen);
+    return used;
+}
+
+/* Returns the total size of the samples when each is compressed on its own as a zlib stream, with the given
+ * dictionary if size is not 0.
+ */
+uint64_t compressed_size(samples_t* samples, int level, uint8_t* dictionary, uint32_t size) {
+    window_t* window = malloc(sizeof(window_t));
+    bitstream_t* stream = malloc(sizeof(bitstream_t));
+    FILE* output = tmpfile();
+    uint32_t position, block_size;
+    uint64_t total = 0;
+
+    assert(window != NULL && stream != NULL && output != NULL);
+
+    for (uint32_t s = 0; s < samples->num_samples; s++) {
+        window_init(window);
+        lzss_set_level(window, level);
+
+        if (size > 0)
+            lzss_set_dictionary(window, dictionary, size);
+
+        rewind(output);
+        bitstream_init(stream, output);
+        position = samples->starts[s];
+
+        do {
+            block_size = samples->starts[s + 1] - position;
+            block_size = (block_size < MAX_BLOCK_SIZE) ? block_size : MAX_BLOCK_SIZE;
+
+            bitstream_push_bit(stream, position + block_size == samples->starts[s + 1]);
+            write_block(stream, window, samples->contents + position, block_size);
+            position += block_size;
+        } while (position < samples->starts[s + 1]);
+
+        bitstream_flush_to_byte(stream);
+        bitstream_finalize(stream);
+
+        // The zlib header, the dictionary's checksum if there is one, and the trailing checksum
+        total += (uint64_t) ftell(output) + 2 + ((size > 0) ? 4 : 0) + 4;
+    }
+
+    fclose(output);
+    free(stream);
+    free(window);
+    return total;
+}
+
+/* Reads the samples, builds the dictionary from the training samples and writes it, then reports how well the held
+ * out samples compress with and without it.
+ */
+int main(int argc, char** argv) {
+    train_options_t options;
+    samples_t training, held_out;
+
+    parse_options(&options, argc, argv);
+    read_samples(options.directory, options.holdout, &training, &held_out);
+    setup_default_code_tables();
+
+    if (training.num_samples == 0) {
+        fprintf(stderr, "%s: no samples to train on in %s\n", argv[0], options.directory);
+        return 1;
+    }
+
+    uint32_t* gains = calloc(training.size, sizeof(uint32_t));
+    uint8_t* dictionary = malloc(options.dictionary_size);
+    assert(gains != NULL && dictionary != NULL);
+
+    collect_gains(&training, options.level, gains);
+    uint32_t size = build_dictionary(&training, gains, dictionary, options.dictionary_size);
+
+    FILE* output = fopen(options.output, "wb");
+
+    if (output == NULL || fwrite(dictionary, 1, size, output) != size || fclose(output) != 0) {
+        perror(options.output);
+        return 1;
+    }
+
+    printf("trained on %u samples (%u bytes), wrote a %u byte dictionary to %s\n", training.num_samples,
+        training.size, size, options.output);
+
+    if (held_out.num_samples > 0) {
+        uint64_t without = compressed_size(&held_out, options.level, dictionary, 0);
+        uint64_t with = compressed_size(&held_out, options.level, dictionary, size);
+
+        printf("held out %u samples (%u bytes) at level %d:\n", held_out.num_samples, held_out.size, options.level);
+        printf("  without dictionary %8llu bytes, ratio %.2f\n", (unsigned long long) without,
+            (double) held_out.size / without);
+        printf("  with dictionary    %8llu bytes, ratio %.2f\n", (unsigned long long) with,
+            (double) held_out.size / with);
+    }
+
+    free(gains);
+    free(dictionary);
+    return 0;
+}